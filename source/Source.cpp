@@ -1,20 +1,43 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <deque>
 #include <limits>
 #include <array>
 #include <tuple>
-#include <set>
 #include <functional>
-#include <sstream>
-#include <queue>
 #include <cassert>
 #include <optional>
 #include <random>
 #include <algorithm>
 #include <type_traits> //is_invocable_v
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <bitset>
+#include <sstream>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace std;
+
+// the contest map is 12x12, other sizes are built with -DMAP_WIDTH=.. -DMAP_HEIGHT=..
+#ifndef MAP_WIDTH
+#define MAP_WIDTH 12
+#endif
+#ifndef MAP_HEIGHT
+#define MAP_HEIGHT 12
+#endif
 /*
 	Constraints
 Allotted response time to output is <= 50ms.
@@ -55,6 +78,159 @@ ostream& operator <<(ostream&out, const  Vec2& v) {
 	return out;
 }
 
+#ifdef _DEBUG
+/* counts heap allocations: steady-state turn must not allocate at all */
+namespace allocations
+{
+	size_t g_count{ 0 };
+}
+void* operator new(size_t size) {
+	allocations::g_count++;
+	if (void* p = malloc(size)) return p;
+	throw bad_alloc{};
+}
+void operator delete(void* p) noexcept {
+	free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+#endif
+
+/* vector with storage inside: all per-turn collections are bounded by the map area */
+template <class T, size_t Capacity>
+class StaticVector {
+public:
+	using value_type = T;
+	using iterator = T*;
+	using const_iterator = const T*;
+
+	StaticVector() = default;
+	StaticVector(initializer_list<T> list) {
+		for (auto& value : list) push_back(value);
+	}
+
+	template <class ...Args>
+	T& emplace_back(Args&&... args) noexcept {
+		assert(m_size < Capacity);
+		m_data[m_size] = T(forward<Args>(args)...);
+		return m_data[m_size++];
+	}
+	void push_back(const T& value) noexcept {
+		assert(m_size < Capacity);
+		m_data[m_size++] = value;
+	}
+	void pop_back() noexcept {
+		assert(m_size > 0);
+		m_size--;
+	}
+	void resize(size_t size) noexcept {
+		assert(size <= Capacity);
+		for (size_t i = m_size; i < size; i++) m_data[i] = T{};
+		m_size = size;
+	}
+	// used with remove_if: [first, last) is dropped, tail is shifted
+	iterator erase(iterator first, iterator last) noexcept {
+		iterator tail{ move(last, end(), first) };
+		m_size = static_cast<size_t>(tail - begin());
+		return first;
+	}
+	void clear() noexcept { m_size = 0; }
+
+	size_t size() const noexcept { return m_size; }
+	constexpr size_t capacity() const noexcept { return Capacity; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	T& operator[](size_t i) noexcept { return m_data[i]; }
+	const T& operator[](size_t i) const noexcept { return m_data[i]; }
+	T& front() noexcept { return m_data[0]; }
+	const T& front() const noexcept { return m_data[0]; }
+	T& back() noexcept { return m_data[m_size - 1]; }
+	const T& back() const noexcept { return m_data[m_size - 1]; }
+
+	iterator begin() noexcept { return m_data.data(); }
+	iterator end() noexcept { return m_data.data() + m_size; }
+	const_iterator begin() const noexcept { return m_data.data(); }
+	const_iterator end() const noexcept { return m_data.data() + m_size; }
+	const_iterator cbegin() const noexcept { return begin(); }
+	const_iterator cend() const noexcept { return end(); }
+	reverse_iterator<iterator> rbegin() noexcept { return reverse_iterator<iterator>(end()); }
+	reverse_iterator<iterator> rend() noexcept { return reverse_iterator<iterator>(begin()); }
+private:
+	array<T, Capacity> m_data;
+	size_t m_size{ 0 };
+};
+
+/* FIFO over fixed ring buffer: every tile is pushed at most once by bfs */
+template <class T, size_t Capacity>
+class RingQueue {
+public:
+	void push(const T& value) noexcept {
+		assert(m_size < Capacity);
+		m_data[(m_head + m_size) % Capacity] = value;
+		m_size++;
+	}
+	void pop() noexcept {
+		assert(m_size > 0);
+		m_head = (m_head + 1) % Capacity;
+		m_size--;
+	}
+	const T& front() const noexcept { return m_data[m_head]; }
+	bool empty() const noexcept { return m_size == 0; }
+	size_t size() const noexcept { return m_size; }
+	void clear() noexcept { m_head = m_size = 0; }
+private:
+	array<T, Capacity> m_data;
+	size_t m_head{ 0 };
+	size_t m_size{ 0 };
+};
+
+/* binary heap over StaticVector: same interface as std::priority_queue */
+template <class T, size_t Capacity, class Compare = less<T>>
+class StaticPriorityQueue {
+public:
+	void push(const T& value) noexcept {
+		m_heap.push_back(value);
+		push_heap(m_heap.begin(), m_heap.end(), Compare{});
+	}
+	template <class ...Args>
+	void emplace(Args&&... args) noexcept {
+		this->push(T(forward<Args>(args)...));
+	}
+	void pop() noexcept {
+		pop_heap(m_heap.begin(), m_heap.end(), Compare{});
+		m_heap.pop_back();
+	}
+	const T& top() const noexcept { return m_heap.front(); }
+	bool empty() const noexcept { return m_heap.empty(); }
+	size_t size() const noexcept { return m_heap.size(); }
+	void clear() noexcept { m_heap.clear(); }
+private:
+	StaticVector<T, Capacity> m_heap;
+};
+
+/* last positions touched by mutations: views catch up from it instead of a full rebuild */
+template <size_t Capacity>
+class ChangeLog {
+public:
+	void Add(Vec2 p) noexcept {
+		m_pos[m_count % Capacity] = p;
+		m_count++;
+	}
+	unsigned Count() const noexcept { return m_count; }
+	// appends positions added after @since, false if some were overwritten or don't fit
+	template <class Out>
+	bool Since(unsigned since, Out& out) const noexcept {
+		unsigned n{ m_count - since };
+		if (n > Capacity || n > out.capacity() - out.size()) return false;
+		for (unsigned i = since; i != m_count; i++) out.push_back(m_pos[i % Capacity]);
+		return true;
+	}
+private:
+	array<Vec2, Capacity> m_pos;
+	unsigned m_count{ 0 };
+};
+
 enum class Tile : char {
 	blocked = '#',
 	neutral = '.',
@@ -69,6 +245,16 @@ constexpr char toChar(Tile ty) noexcept {
 constexpr Tile toTile(char c) noexcept {
 	return static_cast<Tile>(c);
 }
+// 0 for my tiles, 1 for the enemy's, -1 for the rest
+constexpr int SideOf(Tile ty) noexcept {
+	return	(ty == Tile::mActive || ty == Tile::mInactive) ? 0 :
+			(ty == Tile::eActive || ty == Tile::eInactive) ? 1 : -1;
+}
+// the same tile owned by the other side
+constexpr Tile Opposite(Tile ty) noexcept {
+	return	ty == Tile::mActive ? Tile::eActive : ty == Tile::eActive ? Tile::mActive :
+			ty == Tile::mInactive ? Tile::eInactive : ty == Tile::eInactive ? Tile::mInactive : ty;
+}
 
 namespace ScoreDistribution
 {
@@ -79,7 +265,7 @@ namespace ScoreDistribution
 	const int inactiveTileScore{ 2 };
 	const int defaultScore{ mnScore };
 
-	const int costByLevel[3] = { 10, 20, 30 };
+	constexpr int costByLevel[3] = { 10, 20, 30 };
 	const int salaryByLevel[3] = { 1, 4, 20 };
 
 	const int incomeFromMine{ 4 };
@@ -88,25 +274,118 @@ namespace ScoreDistribution
 };
 namespace sd = ScoreDistribution;
 
+/* switches for optional subsystems */
+namespace Config
+{
+	// precompute analyses on the predicted state while the opponent plays; --ponder sets it
+	bool ponder{ false };
+	// workers for independent analyses, 1 runs everything on the main thread; --threads sets it
+	size_t threads{ 1 };
+	// a turn must be answered within, the first one has 1000 ms
+	chrono::milliseconds turnTime{ 45 }, firstTurnTime{ 900 };
+	// left for the output after the searches
+	chrono::milliseconds reserve{ 5 };
+	// playouts which judge the attack plans and turns they look ahead, 0 doesn't play out
+	int rollouts{ 0 }, horizon{ 3 };
+	// a slower turn is captured with its timings and seed, appended to @captureFile or to cerr if it's empty
+	chrono::milliseconds slowTurn{ 40 };
+	string captureFile{};
+};
+
+/* random keys of everything which can stand on a tile: a state is hashed as XOR of its keys,
+ * so every mutation updates the hash in O(1) */
+namespace zobrist
+{
+	using Key = uint64_t;
+	const int CELLS{ MAP_WIDTH * MAP_HEIGHT };
+	// 6 tile types, units by owner and level, buildings by owner and type, cached queries
+	const int UNITS{ 6 }, BUILDINGS{ UNITS + 6 }, QUERIES{ BUILDINGS + 6 }, KINDS{ QUERIES + 4 };
+	// queries are salted by the side they are made for
+	const int CUT{ 0 }, COMPONENT{ 2 };
+
+	inline const array<array<Key, KINDS>, CELLS>& Keys() noexcept {
+		static const auto keys{ [] {
+			array<array<Key, KINDS>, CELLS> keys;
+			mt19937_64 rng{ 0x2545F4914F6CDD1Dull };
+			for (auto& cell : keys)
+				for (auto& key : cell) key = rng();
+			return keys;
+		}() };
+		return keys;
+	}
+	inline Key Of(Vec2 p, int kind) noexcept {
+		return Keys()[p.y * MAP_WIDTH + p.x][kind];
+	}
+	// 0 for the tile which wasn't read yet
+	inline Key OfTile(Vec2 p, Tile ty) noexcept {
+		switch (ty) {
+		case Tile::blocked:		return Of(p, 0);
+		case Tile::neutral:		return Of(p, 1);
+		case Tile::mActive:		return Of(p, 2);
+		case Tile::mInactive:	return Of(p, 3);
+		case Tile::eActive:		return Of(p, 4);
+		case Tile::eInactive:	return Of(p, 5);
+		}
+		return 0;
+	}
+	inline Key OfUnit(Vec2 p, int owner, int level) noexcept {
+		return Of(p, UNITS + owner * 3 + level - 1);
+	}
+	inline Key OfBuilding(Vec2 p, int owner, int type) noexcept {
+		return Of(p, BUILDINGS + owner * 3 + type);
+	}
+	// @query: CUT or COMPONENT
+	inline Key OfQuery(Vec2 p, int query, int side) noexcept {
+		return Of(p, QUERIES + query + side);
+	}
+};
+
 struct Map {
 	Tile Get(Vec2 pos) const noexcept {
 		return m_map[pos.y][pos.x];
 	}
-	void Read() {
-		for (int i = 0; i < SIZE; i++) {
+	// every change of a tile bumps the version of the sides it was and became
+	void Set(Vec2 pos, Tile ty) noexcept {
+		Tile& tile{ m_map[pos.y][pos.x] };
+		if (tile == ty) return;
+		if (SideOf(tile) >= 0) m_version[SideOf(tile)]++;
+		if (SideOf(ty) >= 0) m_version[SideOf(ty)]++;
+		m_hash ^= zobrist::OfTile(pos, tile) ^ zobrist::OfTile(pos, ty);
+		tile = ty;
+		m_changes.Add(pos);
+	}
+	// only tiles which differ from the current ones are set, they are appended to @changed
+	template <class Changed>
+	void Read(Changed& changed) {
+		for (int i = 0; i < HEIGHT; i++) {
 			string s; cin >> s;  cin.ignore();
-			for (int j = 0; j < SIZE; j++) 
-				m_map[i][j] = toTile(s[j]);
+			for (int j = 0; j < WIDTH; j++) {
+				this->Assign(Vec2{ j, i }, toTile(s[j]), changed);
+			}
 		}
 	}
+	template <class Changed>
+	void Assign(Vec2 pos, Tile ty, Changed& changed) {
+		if (this->Get(pos) == ty) return;
+		changed.push_back(pos);
+		this->Set(pos, ty);
+	}
 	// data
-	static const int SIZE{ 12 };
-	array<array<Tile, SIZE>, SIZE> m_map;
+	static const int WIDTH{ MAP_WIDTH }, HEIGHT{ MAP_HEIGHT };
+	static const int AREA{ WIDTH * HEIGHT };
+	array<array<Tile, WIDTH>, HEIGHT> m_map{};
+	unsigned m_version[2]{ 0, 0 }; // per side
+	ChangeLog<64> m_changes;
+	zobrist::Key m_hash{ 0 }; // of tiles
 };
+static_assert(Map::AREA <= zobrist::CELLS, "zobrist keys don't cover the map");
 constexpr bool IsValid(Vec2 pos) noexcept {
 	return	pos.x >= 0 && pos.y >= 0 &&
-			pos.x < Map::SIZE && pos.y < Map::SIZE;
+			pos.x < Map::WIDTH && pos.y < Map::HEIGHT;
 }
+using Neighbors = StaticVector<Vec2, 4>;
+using TileList	= StaticVector<pair<Vec2, int>, Map::AREA>;
+using BridgeList = StaticVector<pair<Vec2, Vec2>, Map::AREA>;
 
 enum class BType: int {
 	HQ = 0,
@@ -162,7 +441,8 @@ struct Player {
 		cin >> m_income; cin.ignore();
 	}
 
-	bool CanCreateUnits(const vector<int> & levels ) const noexcept {
+	template <class Levels>
+	bool CanCreateUnits(const Levels& levels ) const noexcept {
 		Player dummy = *this; //copy
 		bool is = true;
 		for (auto level : levels) {
@@ -210,6 +490,58 @@ struct Player {
 	int m_upkeep;
 };
 
+struct Unit {
+	Unit() {};
+
+	Unit(int owner, int id, int level, Vec2 pos) :
+		m_owner(owner),
+		m_id(id),
+		m_level(level),
+		m_pos(pos) {};
+
+	void Read() {
+		cin >> m_owner >> m_id >> m_level >> m_pos;
+		cin.ignore();
+	}
+
+	bool IsMy() const noexcept {
+		return m_owner == 0;
+	}
+
+	bool CanKill(const Unit& u) const noexcept {
+		return u.m_level < m_level || m_level == 3;
+	}
+
+	int	m_owner;
+	int m_id;
+	int m_level;
+	Vec2 m_pos;
+};
+
+/* what the input of a turn changed in the state left by the previous one */
+struct TurnDelta {
+	void Clear() noexcept {
+		m_tiles.clear();
+		m_appeared.clear(), m_disappeared.clear(), m_moved.clear();
+		m_built.clear(), m_destroyed.clear();
+	}
+	size_t Size() const noexcept {
+		return	m_tiles.size() + m_appeared.size() + m_disappeared.size() + 2 * m_moved.size() +
+				m_built.size() + m_destroyed.size();
+	}
+	// patching views costs more than rebuilding them
+	bool IsLarge() const noexcept {
+		return this->Size() > Map::AREA / 4;
+	}
+
+	StaticVector<Vec2, Map::AREA>	m_tiles;
+	StaticVector<Unit, Map::AREA>	m_appeared,
+									m_disappeared;
+	StaticVector<pair<Vec2, Unit>, Map::AREA> m_moved; // from where and the unit now
+	StaticVector<Building, Map::AREA> m_built,
+									m_destroyed;
+};
+
 struct BuildingManager {
 
 	void ReadMines() {
@@ -224,24 +556,51 @@ struct BuildingManager {
 		}
 	}
 	
-	void Read() {
+	// buildings are kept in input order, only built and destroyed ones are touched
+	void Read(TurnDelta& delta) {
 		int buildingCount;
 		cin >> buildingCount; cin.ignore();
 
-		m_buildings.clear();
-		m_buildings.reserve(buildingCount);
-
+		StaticVector<Building, Map::AREA> buildings;
 		for (int i = 0; i < buildingCount; i++) {
 			int owner;
 			int buildingType;
 			Vec2 pos;
 			cin >> owner >> buildingType >> pos; cin.ignore();
-			m_buildings.emplace_back(owner, ::toBType(buildingType), pos);
+			buildings.emplace_back(owner, ::toBType(buildingType), pos);
 		}
+		this->Assign(buildings, delta);
+	}
+	void Assign(const StaticVector<Building, Map::AREA>& buildings, TurnDelta& delta) {
+		auto same = [](const Building& b) {
+			return [&b](const Building& o) {
+				return o.m_owner == b.m_owner && o.m_type == b.m_type && o.m_pos == b.m_pos;
+			};
+		};
+		for (auto& b : m_buildings) {
+			if (none_of(buildings.begin(), buildings.end(), same(b))) {
+				delta.m_destroyed.push_back(b);
+				this->Touch(b);
+			}
+		}
+		for (auto& b : buildings) {
+			if (none_of(m_buildings.begin(), m_buildings.end(), same(b))) {
+				delta.m_built.push_back(b);
+				this->Touch(b);
+			}
+		}
+		m_buildings = buildings;
 	}
 
 	void AddBuilding(int owner, BType type, Vec2 pos) {
 		m_buildings.emplace_back(owner, type, pos);
+		this->Touch(m_buildings.back());
+	}
+	// called once when @b appears and once when it's gone: XOR toggles its key
+	void Touch(const Building& b) noexcept {
+		m_version[b.m_owner]++;
+		m_changes.Add(b.m_pos);
+		m_hash ^= zobrist::OfBuilding(b.m_pos, b.m_owner, toInt(b.m_type));
 	}
 
 	optional<Building> GetBuildingAt(Vec2 pos) const noexcept {
@@ -276,79 +635,100 @@ struct BuildingManager {
 		return false;
 	}
 
-	vector<Building> GetMines(bool isMy) const noexcept {
-		vector<Building> mines;
-		for_each(m_buildings.begin(), m_buildings.end(),[&mines,&isMy](auto& b) {
-			if(isMy == b.IsMy() && b.IsMine()) mines.emplace_back(b);
+	StaticVector<Building, Map::AREA> GetMines(int owner) const noexcept {
+		StaticVector<Building, Map::AREA> mines;
+		for_each(m_buildings.begin(), m_buildings.end(),[&mines,&owner](auto& b) {
+			if(owner == b.m_owner && b.IsMine()) mines.emplace_back(b);
 		});
 		return mines;
 	}
 
-	vector<Building> GetTowers(bool isMy) const noexcept {
-		vector<Building> towers;
-		for_each(m_buildings.begin(), m_buildings.end(), [&towers, &isMy](auto& b) {
-			if (isMy == b.IsMy()&& b.IsTower()) towers.emplace_back(b);
+	StaticVector<Building, Map::AREA> GetTowers(int owner) const noexcept {
+		StaticVector<Building, Map::AREA> towers;
+		for_each(m_buildings.begin(), m_buildings.end(), [&towers, &owner](auto& b) {
+			if (owner == b.m_owner && b.IsTower()) towers.emplace_back(b);
 		});
 		return towers;
 	}
 
-	size_t Count(BType ty, bool isMy) const noexcept {
-		return (size_t)count_if(m_buildings.begin(), m_buildings.end(), [&ty, &isMy](auto& b) {
-			return (isMy == b.IsMy() && b.m_type == ty);
+	size_t Count(BType ty, int owner) const noexcept {
+		return (size_t)count_if(m_buildings.begin(), m_buildings.end(), [&ty, &owner](auto& b) {
+			return (owner == b.m_owner && b.m_type == ty);
 		});
 	}
 
+	Vec2 HQ(int owner) const noexcept {
+		auto it = find_if(m_buildings.begin(), m_buildings.end(), [&owner](const Building& b) {
+			return b.IsHQ() && b.m_owner == owner;
+		});
+		assert(it != m_buildings.end());
+		return it->m_pos;
+	}
+
 	bool IsMineSpot(Vec2 p) const noexcept {
 		return any_of(m_mines.begin(), m_mines.end(), [&p](auto&mine) {return mine.m_pos == p; });
 	}
 
 	// data
-	vector<Building> m_buildings;// owned buildings
+	StaticVector<Building, Map::AREA> m_buildings;// owned buildings
 	vector<Mine> m_mines; // all mines
-};
-
-struct Unit {
-	Unit() {};
-
-	Unit(int owner, int id, int level, Vec2 pos) :
-		m_owner(owner),
-		m_id(id),
-		m_level(level),
-		m_pos(pos) {};
-
-	void Read() {
-		cin >> m_owner >> m_id >> m_level >> m_pos;
-		cin.ignore();
-	}
-
-	bool IsMy() const noexcept {
-		return m_owner == 0;
-	}
-
-	bool CanKill(const Unit& u) const noexcept {
-		return u.m_level < m_level || m_level == 3;
-	}
-
-	int	m_owner;
-	int m_id;
-	int m_level;
-	Vec2 m_pos;
+	unsigned m_version[2]{ 0, 0 }; // per owner
+	ChangeLog<64> m_changes;
+	zobrist::Key m_hash{ 0 };
 };
 
 struct UnitManager {
-	void Read() {
+	// units are kept in input order and matched by id: trained ones (undef id) are replaced by the real ones
+	void Read(TurnDelta& delta) {
 		int unitCount;
 		cin >> unitCount; cin.ignore();
 
-		m_units.clear();
-		m_units.resize(unitCount);
-		for (auto& unit: m_units) {
+		StaticVector<Unit, Map::AREA> units;
+		units.resize(unitCount);
+		for (auto& unit: units) {
 			unit.Read();
 		}
+		this->Assign(units, delta);
+	}
+	void Assign(const StaticVector<Unit, Map::AREA>& units, TurnDelta& delta) {
+		auto byId = [](const Unit& u) {
+			return [&u](const Unit& o) { return o.m_id == u.m_id; };
+		};
+		for (auto& old : m_units) {
+			auto it = find_if(units.begin(), units.end(), byId(old));
+			if (it == units.end()) {
+				delta.m_disappeared.push_back(old);
+				this->Touch(old);
+			}
+			else if (it->m_pos != old.m_pos || it->m_level != old.m_level) {
+				delta.m_moved.emplace_back(old.m_pos, *it);
+				this->Touch(old);
+				this->Touch(*it);
+			}
+		}
+		for (auto& unit : units) {
+			if (none_of(m_units.begin(), m_units.end(), byId(unit))) {
+				delta.m_appeared.push_back(unit);
+				this->Touch(unit);
+			}
+		}
+		m_units = units;
 	}
 
 	void AddUnit(int owner, int id, int level, Vec2 pos) {
 		m_units.emplace_back(owner, id, level, pos);
+		this->Touch(m_units.back());
+	}
+	void MoveUnit(Unit& unit, Vec2 pos) noexcept {
+		this->Touch(unit);
+		unit.m_pos = pos;
+		this->Touch(unit);
+	}
+	// called once when @u appears or leaves the tile, once when it's gone
+	void Touch(const Unit& u) noexcept {
+		m_version[u.m_owner]++;
+		m_changes.Add(u.m_pos);
+		m_hash ^= zobrist::OfUnit(u.m_pos, u.m_owner, u.m_level);
 	}
 
 	optional<Unit> GetUnitAt(const Vec2&pos) const noexcept {
@@ -368,42 +748,61 @@ struct UnitManager {
 	void RemoveMarkedUnits() noexcept{
 		int id = m_idForRemove;
 		m_units.erase(
-			remove_if(m_units.begin(), m_units.end(), [id](const Unit&u) {
-				if (u.m_id == id) cerr << "Remove unit at " << u.m_pos << endl;
+			remove_if(m_units.begin(), m_units.end(), [id, this](const Unit&u) {
+				if (u.m_id == id) {
+					cerr << "Remove unit at " << u.m_pos << endl;
+					this->Touch(u);
+				}
 				return u.m_id == id;
 			}),
 			m_units.end()
 		);
 	}
-	vector<Unit> m_units;
+	StaticVector<Unit, Map::AREA> m_units;
 	int m_idForRemove{ -1000 };
+	unsigned m_version[2]{ 0, 0 }; // per owner
+	ChangeLog<64> m_changes;
+	zobrist::Key m_hash{ 0 };
+};
+/* command text formatted in place: no stringstream, no heap */
+struct Command {
+	static const size_t CAPACITY{ 32 }; // "BUILD TOWER 11 11;" is the longest but MSG, its text must fit too
+
+	const char* c_str() const noexcept { return m_text.data(); }
+	size_t size() const noexcept { return m_length; }
+
+	array<char, CAPACITY> m_text{};
+	size_t m_length{ 0 };
 };
+ostream& operator <<(ostream&out, const Command& cmd) {
+	out.write(cmd.c_str(), cmd.size());
+	return out;
+}
+
 namespace commands 
 {
-	string Move(int id, Vec2 pos) {
-		stringstream ss;
-		ss << "MOVE " << id << " " << pos.x << " " << pos.y << ";";
-		return ss.str();
-	}
-	string Train(int level, Vec2 pos) {
-		stringstream ss;
-		ss << "TRAIN " << level << " " << pos.x << " " << pos.y << ";";
-		return ss.str();
-	}
-	string Wait() {
-		stringstream ss;
-		ss << "WAIT;";
-		return ss.str();
-	}
-	string Msg(const char* msg) {
-		stringstream ss;
-		ss << "MSG " << msg << ";";
-		return ss.str();
-	}
-	string Build(BType ty, Vec2 pos) {
-		stringstream ss;
-		ss << "BUILD " << (ty == BType::Mine? "MINE": "TOWER") << " " << pos.x << " " << pos.y << ";";
-		return ss.str();
+	template <class ...Args>
+	Command Format(const char* format, Args... args) noexcept {
+		Command cmd;
+		int length = snprintf(cmd.m_text.data(), Command::CAPACITY, format, args...);
+		assert(length >= 0 && length < static_cast<int>(Command::CAPACITY)); // a truncated command is a wrong one
+		cmd.m_length = static_cast<size_t>(max(0, min(length, (int)Command::CAPACITY - 1)));
+		return cmd;
+	}
+	Command Move(int id, Vec2 pos) {
+		return Format("MOVE %d %d %d;", id, pos.x, pos.y);
+	}
+	Command Train(int level, Vec2 pos) {
+		return Format("TRAIN %d %d %d;", level, pos.x, pos.y);
+	}
+	Command Wait() {
+		return Format("WAIT;");
+	}
+	Command Msg(const char* msg) {
+		return Format("MSG %s;", msg);
+	}
+	Command Build(BType ty, Vec2 pos) {
+		return Format("BUILD %s %d %d;", (ty == BType::Mine ? "MINE" : "TOWER"), pos.x, pos.y);
 	}
 }
 
@@ -413,109 +812,784 @@ struct Data {
 			m_enemy;
 	BuildingManager m_bManager;
 	UnitManager		m_uManager;
+	TurnDelta		m_delta; // against the state left by the previous turn
+
+	// mutation counters of tiles, units and buildings of both sides, then sizes of their change logs
+	using Stamp = array<unsigned, 9>;
+	// positions touched since some stamp, more of them means the change is too large to patch
+	using Changes = StaticVector<Vec2, Map::AREA / 4>;
 
 	void Update() {
 		m_me.Read();
 		m_enemy.Read();
-		m_map.Read();
-		m_bManager.Read();
-		m_uManager.Read();
+		m_delta.Clear();
+		m_map.Read(m_delta.m_tiles);
+		m_bManager.Read(m_delta);
+		m_uManager.Read(m_delta);
+		this->Settle();
+	}
+	// the turn is read: its delta is logged and the upkeep is recounted
+	void Settle() {
+		cerr << "Delta: " << m_delta.m_tiles.size() << " tiles, units +" << m_delta.m_appeared.size()
+			<< " -" << m_delta.m_disappeared.size() << " ~" << m_delta.m_moved.size()
+			<< ", buildings +" << m_delta.m_built.size() << " -" << m_delta.m_destroyed.size() << endl;
 
-		m_me.m_upkeep = 0;
+		m_me.m_upkeep = m_enemy.m_upkeep = 0;
 		for (auto& unit : m_uManager.m_units) {
-			if(unit.IsMy()) m_me.m_upkeep += sd::salaryByLevel[unit.m_level - 1];
+			auto& owner{ unit.IsMy() ? m_me : m_enemy };
+			owner.m_upkeep += sd::salaryByLevel[unit.m_level - 1];
 		}
 	}
 	void Init() {
 		m_bManager.ReadMines();
 	}
+	// tiles, units and buildings: equal states have equal hashes
+	zobrist::Key Hash() const noexcept {
+		return m_map.m_hash ^ m_uManager.m_hash ^ m_bManager.m_hash;
+	}
+	Stamp GetStamp() const noexcept {
+		return {
+			m_map.m_version[0], m_map.m_version[1],
+			m_uManager.m_version[0], m_uManager.m_version[1],
+			m_bManager.m_version[0], m_bManager.m_version[1],
+			m_map.m_changes.Count(), m_uManager.m_changes.Count(), m_bManager.m_changes.Count()
+		};
+	}
+	bool ChangesSince(const Stamp& since, Changes& changes) const noexcept {
+		return	m_map.m_changes.Since(since[6], changes) &&
+				m_uManager.m_changes.Since(since[7], changes) &&
+				m_bManager.m_changes.Since(since[8], changes);
+	}
 };
 
-/* look for bridges */
-class Bridges {
-public:
-	Bridges(Map* map) :
-		m_map(map),
-		m_shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} }
-	{//default ctor
-		m_mHQ = Vec2{ 0,0 }, m_eHQ = Vec2{ 11,11 };
-		if (map->Get(Vec2{ 0,0 }) == Tile::eActive)
-			swap(m_mHQ, m_eHQ);
+/* point of view of the planner: tiles, player and HQ of a side, its foe is the other one */
+template <int Owner>
+struct Side {
+	using Foe = Side<1 - Owner>;
+
+	static constexpr int owner{ Owner };
+	static constexpr Tile active{ Owner == 0 ? Tile::mActive : Tile::eActive };
+	static constexpr Tile inactive{ Owner == 0 ? Tile::mInactive : Tile::eInactive };
+
+	static constexpr bool Owns(int o) noexcept { return o == Owner; }
+	static Player& Self(Data& data) noexcept {
+		if constexpr (Owner == 0) return data.m_me;
+		else return data.m_enemy;
 	}
+	static Vec2 HQ(const Data& data) noexcept { return data.m_bManager.HQ(Owner); }
+};
+using MySide = Side<0>;
+using EnemySide = Side<1>;
 
-	vector<pair<Vec2, Vec2>>&& GetBridges(Tile type) noexcept {
-		this->Clear();
+/* binary corpus of recorded turns: a header, fixed-size turn records, then the games with their mine spots
+ * and first turns as the index. The file is mapped and the records are decoded in place */
+namespace replay
+{
+	const uint32_t MAGIC{ 0x31464349 }; // "ICF1"
+	const int MAX_MINES{ Map::AREA / 4 };
+	// index of a tile, also counts the pieces of a turn: a byte on the contest map
+	using Cell = conditional_t<(Map::AREA < 256), uint8_t, uint16_t>;
+
+	struct Header {
+		uint32_t magic{ MAGIC };
+		uint32_t turns{ 0 };
+		uint32_t games{ 0 };
+		uint32_t index{ 0 }; // offset of the games
+		uint16_t width{ Map::WIDTH }, height{ Map::HEIGHT };
+	};
+	struct GameRecord {
+		uint32_t first{ 0 }; // its first turn
+		uint32_t turns{ 0 };
+		Cell mines{ 0 };
+		Cell mine[MAX_MINES]{}; // cells: y * WIDTH + x
+	};
+	// a turn as the referee sends it, a tile takes a nibble
+	struct TurnRecord {
+		struct Piece {
+			uint16_t id; // 0 for buildings
+			Cell cell;
+			uint8_t kind; // owner << 2 | level of a unit or type of a building
+		};
+		int32_t gold[2], income[2];
+		uint8_t tiles[(Map::AREA + 1) / 2];
+		Cell units, buildings;
+		Piece pieces[Map::AREA]; // units, then buildings: a tile holds one of them at most
+	};
+	static_assert(is_trivially_copyable_v<TurnRecord> && is_trivially_copyable_v<GameRecord>, "records are mapped in place");
+	static_assert(sizeof(Header) % alignof(TurnRecord) == 0 && sizeof(TurnRecord) % alignof(GameRecord) == 0, "records are aligned");
 
-		Vec2 start{ type == Tile::eActive ? m_eHQ : m_mHQ};
-		assert(m_bridges.empty());
-		this->Dfs(start, Vec2{ -1,-1 }, type);
-		for (int y = 0; y < Map::SIZE; y++) {
-			for (int x = 0; x < Map::SIZE; x++) {
-				Vec2 v{ x, y };
-				if (!m_visited[y][x] && m_map->Get(v) == type)
-					this->Dfs(v, Vec2{ -1,-1 }, type);
-			}
+	const Tile TILES[]{ Tile::blocked, Tile::neutral, Tile::mActive, Tile::mInactive, Tile::eActive, Tile::eInactive };
+	inline uint8_t CodeOf(Tile ty) noexcept {
+		return static_cast<uint8_t>(find(begin(TILES), end(TILES), ty) - begin(TILES));
+	}
+	inline Cell CellOf(Vec2 p) noexcept { return static_cast<Cell>(p.y * Map::WIDTH + p.x); }
+	inline Vec2 PosOf(Cell cell) noexcept { return { cell % Map::WIDTH, cell / Map::WIDTH }; }
+
+	// the state read by @data, false if it doesn't fit a record
+	inline bool Encode(const Data& data, TurnRecord& turn) noexcept {
+		turn = TurnRecord{};
+		const Player* players[2]{ &data.m_me, &data.m_enemy };
+		for (int side = 0; side < 2; side++) {
+			turn.gold[side] = players[side]->m_gold;
+			turn.income[side] = players[side]->m_income;
+		}
+		for (int i = 0; i < Map::AREA; i++) {
+			turn.tiles[i / 2] |= CodeOf(data.m_map.Get(PosOf(static_cast<Cell>(i)))) << (i % 2 * 4);
+		}
+		auto& units{ data.m_uManager.m_units };
+		auto& buildings{ data.m_bManager.m_buildings };
+		if (units.size() + buildings.size() > Map::AREA) return false;
+		turn.units = static_cast<Cell>(units.size());
+		turn.buildings = static_cast<Cell>(buildings.size());
+		auto piece{ turn.pieces };
+		for (auto& u : units) {
+			if (u.m_id < 0 || u.m_id > numeric_limits<uint16_t>::max()) return false;
+			*piece++ = { static_cast<uint16_t>(u.m_id), CellOf(u.m_pos), static_cast<uint8_t>(u.m_owner << 2 | u.m_level) };
+		}
+		for (auto& b : buildings) {
+			*piece++ = { 0, CellOf(b.m_pos), static_cast<uint8_t>(b.m_owner << 2 | toInt(b.m_type)) };
+		}
+		return true;
+	}
+	// mine spots of @data, false if there are too many
+	inline bool Encode(const Data& data, GameRecord& game) noexcept {
+		auto& mines{ data.m_bManager.m_mines };
+		if (mines.size() > MAX_MINES) return false;
+		game = GameRecord{};
+		for (auto& mine : mines) game.mine[game.mines++] = CellOf(mine.m_pos);
+		return true;
+	}
+	// as Data::Init does
+	inline void Decode(const GameRecord& game, Data& data) {
+		auto& mines{ data.m_bManager.m_mines };
+		mines.clear();
+		for (int i = 0; i < game.mines; i++) mines.emplace_back(PosOf(game.mine[i]));
+	}
+	// as Data::Update does
+	inline void Decode(const TurnRecord& turn, Data& data) {
+		Player* players[2]{ &data.m_me, &data.m_enemy };
+		for (int side = 0; side < 2; side++) {
+			players[side]->m_gold = turn.gold[side];
+			players[side]->m_income = turn.income[side];
+		}
+		data.m_delta.Clear();
+		for (int i = 0; i < Map::AREA; i++) {
+			auto ty{ TILES[turn.tiles[i / 2] >> (i % 2 * 4) & 0xF] };
+			data.m_map.Assign(PosOf(static_cast<Cell>(i)), ty, data.m_delta.m_tiles);
+		}
+		StaticVector<Building, Map::AREA> buildings;
+		for (int i = 0; i < turn.buildings; i++) {
+			auto& b{ turn.pieces[turn.units + i] };
+			buildings.emplace_back(b.kind >> 2, toBType(b.kind & 3), PosOf(b.cell));
+		}
+		data.m_bManager.Assign(buildings, data.m_delta);
+		StaticVector<Unit, Map::AREA> units;
+		for (int i = 0; i < turn.units; i++) {
+			auto& u{ turn.pieces[i] };
+			units.emplace_back(u.kind >> 2, u.id, u.kind & 3, PosOf(u.cell));
+		}
+		data.m_uManager.Assign(units, data.m_delta);
+		data.Settle();
+	}
+	// input of the referee which leads to @data, the mine spots first if @mines is set
+	inline void Print(const Data& data, ostream& out, bool mines) {
+		if (mines) {
+			out << data.m_bManager.m_mines.size() << "\n";
+			for (auto& mine : data.m_bManager.m_mines) out << mine.m_pos.x << " " << mine.m_pos.y << "\n";
+		}
+		for (auto player : { &data.m_me, &data.m_enemy }) {
+			out << player->m_gold << "\n" << player->m_income << "\n";
+		}
+		for (auto& row : data.m_map.m_map) {
+			for (auto tile : row) out << toChar(tile);
+			out << "\n";
+		}
+		out << data.m_bManager.m_buildings.size() << "\n";
+		for (auto& b : data.m_bManager.m_buildings) {
+			out << b.m_owner << " " << toInt(b.m_type) << " " << b.m_pos.x << " " << b.m_pos.y << "\n";
+		}
+		out << data.m_uManager.m_units.size() << "\n";
+		for (auto& u : data.m_uManager.m_units) {
+			out << u.m_owner << " " << u.m_id << " " << u.m_level << " " << u.m_pos.x << " " << u.m_pos.y << "\n";
 		}
-
-		return move(m_bridges);
 	}
-private:
-	void Dfs(Vec2 v, Vec2 p, Tile type) noexcept {
-		m_visited[v.y][v.x] = true;
 
-		m_start[v.y][v.x] = m_finish[v.y][v.x] = m_timer++;
+	/* records are appended as they come, the index and the header are written on close */
+	class Writer {
+	public:
+		explicit Writer(const string& path) :
+			m_out(path, ios::binary)
+		{
+			m_out.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+		}
+		~Writer() {
+			this->Close();
+		}
+		bool IsOpen() const noexcept { return m_out.is_open(); }
+		// the turns added next are of a game on the mine spots of @data
+		bool Begin(const Data& data) {
+			GameRecord game;
+			if (!Encode(data, game)) return false;
+			game.first = m_header.turns;
+			m_games.push_back(game);
+			return true;
+		}
+		bool Add(const Data& data) {
+			TurnRecord turn;
+			if (m_games.empty() || !Encode(data, turn)) return false;
+			m_out.write(reinterpret_cast<const char*>(&turn), sizeof(turn));
+			m_header.turns++;
+			m_games.back().turns++;
+			return true;
+		}
+		void Close() {
+			if (!m_out.is_open()) return;
+			m_header.games = static_cast<uint32_t>(m_games.size());
+			m_header.index = static_cast<uint32_t>(sizeof(Header) + m_header.turns * sizeof(TurnRecord));
+			m_out.write(reinterpret_cast<const char*>(m_games.data()), m_games.size() * sizeof(GameRecord));
+			m_out.seekp(0);
+			m_out.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+			m_out.close();
+		}
+	private:
+		ofstream m_out;
+		Header m_header;
+		vector<GameRecord> m_games;
+	};
 
-		for (auto& sh : m_shift) {
-			auto to{ v + sh };
-			if (!IsValid(to)) continue;
-			auto ty{ m_map->Get(to) };
-			if (type != ty || to == p) continue;
-			if (m_visited[to.y][to.x])
-				m_finish[v.y][v.x] = min(m_finish[v.y][v.x], m_start[to.y][to.x]);
-			else {
-				Dfs(to, v, type);
-				m_finish[v.y][v.x] = min(m_finish[v.y][v.x], m_finish[to.y][to.x]);
-				if (m_finish[to.y][to.x] > m_start[v.y][v.x])
-				{//found bridge
-				//	 cerr << "Bridge: " << v << " - " << to << endl;
-					m_bridges.emplace_back(v, to);
+	/* read-only view of a corpus file: mapped where mmap exists, read once elsewhere */
+	class Corpus {
+	public:
+		explicit Corpus(const string& path) {
+			this->Open(path);
+			if (!this->IsValid()) m_header = nullptr;
+		}
+		~Corpus() {
+#ifdef HAS_MMAP
+			if (m_begin) munmap(const_cast<char*>(m_begin), m_size);
+#endif
+		}
+		Corpus(const Corpus&) = delete;
+		Corpus& operator=(const Corpus&) = delete;
+		// false if the file is missing or isn't a corpus
+		bool IsOpen() const noexcept { return m_header != nullptr; }
+		size_t Turns() const noexcept { return m_header->turns; }
+		size_t Games() const noexcept { return m_header->games; }
+		const TurnRecord& Turn(size_t i) const noexcept { return m_turns[i]; }
+		const GameRecord& Game(size_t i) const noexcept { return m_games[i]; }
+	private:
+		void Open(const string& path) {
+#ifdef HAS_MMAP
+			int fd{ open(path.c_str(), O_RDONLY) };
+			if (fd < 0) return;
+			struct stat info;
+			if (fstat(fd, &info) == 0 && info.st_size > 0) {
+				void* mapped{ mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) };
+				if (mapped != MAP_FAILED) {
+					m_begin = static_cast<const char*>(mapped);
+					m_size = static_cast<size_t>(info.st_size);
 				}
 			}
+			close(fd);
+#else
+			ifstream in{ path, ios::binary };
+			m_buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+			m_begin = m_buffer.data();
+			m_size = m_buffer.size();
+#endif
+			if (!m_begin || m_size < sizeof(Header)) return;
+			m_header = reinterpret_cast<const Header*>(m_begin);
+			m_turns = reinterpret_cast<const TurnRecord*>(m_begin + sizeof(Header));
+			m_games = reinterpret_cast<const GameRecord*>(m_begin + m_header->index);
 		}
-	}
-	void Clear() noexcept {
-		for (int i = 0; i < Map::SIZE; i++) {
-			for (int j = 0; j < Map::SIZE; j++) {
-				m_visited[i][j] = false;
-				m_start[i][j] = m_finish[i][j] = 0;
+		bool IsValid() const noexcept {
+			if (!m_header || m_header->magic != MAGIC) return false;
+			if (m_header->width != Map::WIDTH || m_header->height != Map::HEIGHT) return false;
+			size_t turnsEnd{ sizeof(Header) + size_t{ m_header->turns } * sizeof(TurnRecord) };
+			if (m_header->index < turnsEnd || m_header->index + size_t{ m_header->games } * sizeof(GameRecord) > m_size) return false;
+			for (size_t i = 0; i < m_header->games; i++) {
+				if (m_games[i].first + size_t{ m_games[i].turns } > m_header->turns || m_games[i].mines > MAX_MINES) return false;
+			for (size_t turn = m_games[i].first; turn < m_games[i].first + m_games[i].turns; turn++) {
+				if (m_turns[turn].units + m_turns[turn].buildings > Map::AREA) return false;
 			}
+			}
+			return true;
 		}
-		m_bridges.clear();
-		m_timer = 0;
-	}
-private:
-	vector<pair<Vec2, Vec2>> m_bridges;
-
-	array<Vec2, 4> m_shift;
-	bool	m_visited[Map::SIZE][Map::SIZE];
-	int		m_start[Map::SIZE][Map::SIZE];
-	int		m_finish[Map::SIZE][Map::SIZE];
-	int		m_timer;
 
-	Map* m_map;
-	Vec2 m_mHQ, m_eHQ;
+		const char* m_begin{ nullptr };
+		size_t m_size{ 0 };
+		const Header* m_header{ nullptr };
+		const TurnRecord* m_turns{ nullptr };
+		const GameRecord* m_games{ nullptr };
+#ifndef HAS_MMAP
+		vector<char> m_buffer;
+#endif
+	};
 };
 
-/* find components connected by bridge in the graph */
-class CCSearch {
+/* tables of the map which don't change during the game: built once on the first turn */
+class StaticMap {
 public:
-	CCSearch(Map*map, UnitManager* uManager, BuildingManager * bManager) :
-		m_map(map),
-		m_uManager(uManager),
-		m_bManager(bManager),
-		m_shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} }
-	{//default ctor
+	// steps between tiles: a byte on the contest map
+	using Distance = conditional_t<(Map::AREA < 255), unsigned char, unsigned short>;
+	static constexpr int UNREACHABLE{ numeric_limits<Distance>::max() };
+	// transform which swaps the HQs: {0,0} <-> {WIDTH-1,HEIGHT-1}, diagonal one on square maps only
+	enum class Symmetry { none, point, diagonal };
+
+	void Build(const Data& data) {
+		auto& map{ data.m_map };
+		auto& bManager{ data.m_bManager };
+		for (int y = 0; y < Map::HEIGHT; y++)
+			for (int x = 0; x < Map::WIDTH; x++)
+				m_passable[y][x] = map.Get(Vec2{ x, y }) != Tile::blocked;
+		this->DetectSymmetry(bManager);
+
+		// the field of the mirrored HQ is mirrored instead of searched
+		m_searches = 0;
+		Vec2 mHQ{ bManager.HQ(0) }, eHQ{ bManager.HQ(1) };
+		this->Bfs(mHQ, m_fields[0]);
+		if (this->IsSymmetric() && this->Mirror(mHQ) == eHQ)
+			this->MirrorField(m_fields[0], m_fields[1]);
+		else 
+			this->Bfs(eHQ, m_fields[1]);
+		// cut points are a property of the whole graph: one linear pass
+		this->FindArticulations();
+		this->MeasureCorridors();
+		m_built = true;
 	}
+	bool IsBuilt() const noexcept { return m_built; }
+
+	// walking distance around blocked tiles, UNREACHABLE if there is no way
+	int FromHQ(int owner, Vec2 p) const noexcept {
+		return m_fields[owner][p.y][p.x];
+	}
+	// the least for tiles which hold the most of the map: narrow crossings of the shortest ways
+	// between HQs first, then cut points of the passable tiles, then the nearest to the HQ of @owner
+	int GuardRank(int owner, Vec2 p) const noexcept {
+		int width{ m_width[p.y][p.x] ? m_width[p.y][p.x] : Map::AREA };
+		return (width * 2 + !m_articulation[p.y][p.x]) * (UNREACHABLE + 1) + this->FromHQ(owner, p);
+	}
+	// blocked tiles and mine spots of the contest maps are symmetric
+	bool IsSymmetric() const noexcept { return m_symmetry != Symmetry::none; }
+	Symmetry GetSymmetry() const noexcept { return m_symmetry; }
+	// has meaning only for symmetric maps
+	Vec2 Mirror(Vec2 p) const noexcept {
+		if (m_symmetry == Symmetry::diagonal)
+			return { Map::WIDTH - 1 - p.y, Map::HEIGHT - 1 - p.x };
+		return { Map::WIDTH - 1 - p.x, Map::HEIGHT - 1 - p.y };
+	}
+	// territory of one side is the mirrored territory of the other one:
+	// analyses of one side can be mirrored for the other
+	bool MirrorsSides(const Map& map) const noexcept {
+		if (!this->IsSymmetric()) return false;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 p{ x, y };
+				if (map.Get(this->Mirror(p)) != Opposite(map.Get(p))) return false;
+			}
+		}
+		return true;
+	}
+	// number of BFS run by the last Build
+	int Searches() const noexcept { return m_searches; }
+private:
+	using Field = array<array<Distance, Map::WIDTH>, Map::HEIGHT>;
+
+	void Bfs(Vec2 start, Field& field) noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		m_searches++;
+		for (auto& row : field) row.fill(UNREACHABLE);
+		RingQueue<Vec2, Map::AREA> Q;
+		field[start.y][start.x] = 0;
+		Q.push(start);
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || !m_passable[to.y][to.x] || field[to.y][to.x] != UNREACHABLE) continue;
+				field[to.y][to.x] = static_cast<Distance>(field[top.y][top.x] + 1);
+				Q.push(to);
+			}
+		}
+	}
+	void MirrorField(const Field& from, Field& to) const noexcept {
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 m{ this->Mirror(Vec2{ x, y }) };
+				to[m.y][m.x] = from[y][x];
+			}
+		}
+	}
+	void FindArticulations() noexcept {
+		m_timer = 0;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				m_articulation[y][x] = false;
+				m_start[y][x] = -1;
+			}
+		}
+		for (int y = 0; y < Map::HEIGHT; y++)
+			for (int x = 0; x < Map::WIDTH; x++)
+				if (m_passable[y][x] && m_start[y][x] < 0)
+					this->Dfs(Vec2{ x, y }, Vec2{ -1, -1 });
+	}
+	void Dfs(Vec2 v, Vec2 parent) noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		m_start[v.y][v.x] = m_low[v.y][v.x] = m_timer++;
+		int children{ 0 };
+		for (auto& sh : shift) {
+			auto to{ v + sh };
+			if (!IsValid(to) || !m_passable[to.y][to.x] || to == parent) continue;
+			if (m_start[to.y][to.x] >= 0) {
+				m_low[v.y][v.x] = min(m_low[v.y][v.x], m_start[to.y][to.x]);
+				continue;
+			}
+			this->Dfs(to, v);
+			children++;
+			m_low[v.y][v.x] = min(m_low[v.y][v.x], m_low[to.y][to.x]);
+			if (IsValid(parent) && m_low[to.y][to.x] >= m_start[v.y][v.x])
+				m_articulation[v.y][v.x] = true;
+		}
+		if (!IsValid(parent) && children > 1)
+			m_articulation[v.y][v.x] = true;
+	}
+	// tiles of the shortest ways between HQs get the number of such tiles with the same distance
+	void MeasureCorridors() noexcept {
+		for (auto& row : m_width) row.fill(0);
+		Vec2 eHQ{ -1, -1 };
+		for (int y = 0; y < Map::HEIGHT; y++)
+			for (int x = 0; x < Map::WIDTH; x++)
+				if (m_fields[1][y][x] == 0) eHQ = Vec2{ x, y };
+		int between{ m_fields[0][eHQ.y][eHQ.x] };
+		if (between == UNREACHABLE) return;
+
+		int layer[Map::AREA]{};
+		auto onWay = [&](int x, int y) { return m_fields[0][y][x] + m_fields[1][y][x] == between; };
+		for (int y = 0; y < Map::HEIGHT; y++)
+			for (int x = 0; x < Map::WIDTH; x++)
+				if (onWay(x, y)) layer[m_fields[0][y][x]]++;
+		for (int y = 0; y < Map::HEIGHT; y++)
+			for (int x = 0; x < Map::WIDTH; x++)
+				if (onWay(x, y)) m_width[y][x] = layer[m_fields[0][y][x]];
+	}
+	// first transform which maps blocked tiles and mine spots onto themselves
+	void DetectSymmetry(const BuildingManager& bManager) noexcept {
+		auto& mines{ bManager.m_mines };
+		for (auto candidate : { Symmetry::point, Symmetry::diagonal }) {
+			if (candidate == Symmetry::diagonal && Map::WIDTH != Map::HEIGHT) break;
+			m_symmetry = candidate;
+			bool symmetric{ true };
+			for (int y = 0; y < Map::HEIGHT && symmetric; y++) {
+				for (int x = 0; x < Map::WIDTH && symmetric; x++) {
+					Vec2 m{ this->Mirror(Vec2{ x, y }) };
+					symmetric = m_passable[y][x] == m_passable[m.y][m.x];
+				}
+			}
+			for (auto& mine : mines) {
+				symmetric &= find(mines.begin(), mines.end(), Mine{ this->Mirror(mine.m_pos) }) != mines.end();
+			}
+			if (symmetric) return;
+		}
+		m_symmetry = Symmetry::none;
+	}
+
+	bool	m_built{ false };
+	bool	m_passable[Map::HEIGHT][Map::WIDTH];
+	// my HQ, enemy HQ
+	Field	m_fields[2];
+	bool	m_articulation[Map::HEIGHT][Map::WIDTH];
+	int		m_start[Map::HEIGHT][Map::WIDTH];
+	int		m_low[Map::HEIGHT][Map::WIDTH];
+	int		m_timer;
+	array<array<int, Map::WIDTH>, Map::HEIGHT> m_width; // of the corridor, 0 off the shortest ways
+	Symmetry m_symmetry{ Symmetry::none };
+	int		m_searches{ 0 };
+};
+
+/* steps to the nearest goal around blocked tiles: units follow the decreasing distance */
+class FlowField {
+public:
+	using Mask = array<array<bool, Map::WIDTH>, Map::HEIGHT>;
+
+	// searches again only when the blocking pattern or the goals were changed
+	bool Update(const Mask& blocked, const Mask& goals) noexcept {
+		if (m_built && m_blocked == blocked && m_goals == goals) return false;
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		m_blocked = blocked, m_goals = goals;
+		m_built = true;
+
+		RingQueue<Vec2, Map::AREA> Q;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				m_distance[y][x] = goals[y][x] ? 0 : StaticMap::UNREACHABLE;
+				if (goals[y][x]) Q.push(Vec2{ x, y });
+			}
+		}
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || blocked[to.y][to.x] || m_distance[to.y][to.x] != StaticMap::UNREACHABLE) continue;
+				m_distance[to.y][to.x] = static_cast<StaticMap::Distance>(m_distance[top.y][top.x] + 1);
+				Q.push(to);
+			}
+		}
+		return true;
+	}
+	// @p may be blocked: i.g. it's occupied by the unit which is going to move
+	int StepsFrom(Vec2 p) const noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		if (m_goals[p.y][p.x]) return 0;
+		int steps{ StaticMap::UNREACHABLE };
+		for (auto& sh : shift) {
+			auto from{ p + sh };
+			if (IsValid(from)) steps = min(steps, m_distance[from.y][from.x] + 1);
+		}
+		return min(steps, StaticMap::UNREACHABLE);
+	}
+private:
+	bool	m_built{ false };
+	Mask	m_blocked;
+	Mask	m_goals;
+	array<array<StaticMap::Distance, Map::WIDTH>, Map::HEIGHT> m_distance;
+};
+
+/* two-source BFS from active territories: who reaches every tile first and by how much */
+class ContestMap {
+public:
+	void Build(const Map& map) noexcept {
+		for (int side = 0; side < 2; side++) {
+			Queue Q;
+			for (int y = 0; y < Map::HEIGHT; y++) {
+				for (int x = 0; x < Map::WIDTH; x++) {
+					bool source{ map.Get(Vec2{ x, y }) == ActiveOf(side) };
+					m_dist[side][y][x] = source ? 0 : StaticMap::UNREACHABLE;
+					m_root[side][y][x] = Vec2{ -1, -1 };
+					if (source) Q.push(Vec2{ x, y });
+				}
+			}
+			this->Spread(map, side, Q);
+		}
+		this->Aggregate(map);
+	}
+	// @p became active tile of @side: only distances of @side decrease
+	void Claim(const Map& map, int side, Vec2 p) noexcept {
+		if (m_dist[1 - side][p.y][p.x] == 0) 
+		{ // the other side lost its tile: its distances increase
+			this->Build(map);
+			return;
+		}
+		// @p may reconnect an inactive component: all its tiles become sources too
+		Queue Q;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (map.Get(Vec2{ x, y }) != ActiveOf(side) || m_dist[side][y][x] == 0) continue;
+				m_dist[side][y][x] = 0;
+				m_root[side][y][x] = Vec2{ -1, -1 };
+				Q.push(Vec2{ x, y });
+			}
+		}
+		this->Spread(map, side, Q);
+		this->Aggregate(map);
+	}
+	// positive if @side reaches @p first
+	int Margin(int side, Vec2 p) const noexcept {
+		return m_dist[1 - side][p.y][p.x] - m_dist[side][p.y][p.x];
+	}
+	// contested neutral tiles which @side reaches through the frontier tile @p
+	int Value(int side, Vec2 p) const noexcept {
+		return m_value[side][p.y][p.x];
+	}
+private:
+	// a tile is queued again for every less root it gets
+	using Queue = RingQueue<Vec2, 4 * Map::AREA>;
+
+	static Tile ActiveOf(int side) noexcept { return side == 0 ? Tile::mActive : Tile::eActive; }
+
+	// relaxes distances from the queued tiles, every tile remembers the first step out of the territory:
+	// the least one of the shortest ways, so the patched labels are the same as the rebuilt ones
+	void Spread(const Map& map, int side, Queue& Q) noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		auto& dist{ m_dist[side] };
+		auto& root{ m_root[side] };
+		auto index = [](Vec2 p) { return p.y * Map::WIDTH + p.x; };
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || map.Get(to) == Tile::blocked) continue;
+				int d{ dist[top.y][top.x] + 1 };
+				Vec2 r{ dist[top.y][top.x] == 0 ? to : root[top.y][top.x] };
+				if (d > dist[to.y][to.x] || (d == dist[to.y][to.x] && index(r) >= index(root[to.y][to.x]))) continue;
+				dist[to.y][to.x] = static_cast<StaticMap::Distance>(d);
+				root[to.y][to.x] = r;
+				Q.push(to);
+			}
+		}
+	}
+	// a tile is contested when the race for it is decided by one step
+	void Aggregate(const Map& map) noexcept {
+		for (int side = 0; side < 2; side++) {
+			for (auto& row : m_value[side]) row.fill(0);
+			for (int y = 0; y < Map::HEIGHT; y++) {
+				for (int x = 0; x < Map::WIDTH; x++) {
+					Vec2 p{ x, y }, root{ m_root[side][y][x] };
+					if (map.Get(p) != Tile::neutral || !IsValid(root) || abs(this->Margin(side, p)) > 1) continue;
+					m_value[side][root.y][root.x]++;
+				}
+			}
+		}
+	}
+
+	array<array<StaticMap::Distance, Map::WIDTH>, Map::HEIGHT> m_dist[2];
+	array<array<Vec2, Map::WIDTH>, Map::HEIGHT> m_root[2];
+	array<array<int, Map::WIDTH>, Map::HEIGHT> m_value[2];
+};
+
+/* towers covering the most of target tiles: greedy max-coverage over bit masks of the tiles.
+ * Gains only fall as targets get covered, so a stale gain from the queue is recomputed
+ * only when it's on top (lazy greedy) */
+class TowerPlanner {
+public:
+	using Mask = bitset<Map::AREA>;
+
+	void Clear() noexcept {
+		m_targets.reset();
+		m_added.reset();
+		m_spots.clear();
+		m_queue.clear();
+	}
+	void AddTarget(Vec2 p) noexcept { m_targets.set(Index(p)); }
+	bool IsTarget(Vec2 p) const noexcept { return m_targets.test(Index(p)); }
+	// tower on @spot protects it and its neighbors, ties are won by the least @rank
+	void AddSpot(Vec2 spot, int rank) noexcept {
+		array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
+		if (m_added.test(Index(spot))) return;
+		m_added.set(Index(spot));
+		Mask cover;
+		for (auto& sh : shift) {
+			auto p{ spot + sh };
+			if (IsValid(p)) cover.set(Index(p));
+		}
+		m_spots.push_back(Spot{ spot, cover, rank });
+		m_queue.emplace(static_cast<int>((cover & m_targets).count()), -rank, -static_cast<int>(m_spots.size() - 1));
+	}
+	// spot which covers the most of uncovered targets, at least @minGain
+	optional<Vec2> Next(int minGain) noexcept {
+		while (!m_queue.empty()) {
+			auto[gain, rank, index] = m_queue.top();
+			m_queue.pop();
+			if (gain < minGain) return nullopt;
+			auto& spot{ m_spots[-index] };
+			int fresh{ static_cast<int>((spot.cover & m_targets).count()) };
+			if (fresh == gain) {
+				m_targets &= ~spot.cover;
+				return spot.pos;
+			}
+			m_queue.emplace(fresh, rank, index);
+		}
+		return nullopt;
+	}
+private:
+	static size_t Index(Vec2 p) noexcept { return static_cast<size_t>(p.y * Map::WIDTH + p.x); }
+
+	struct Spot {
+		Vec2	pos;
+		Mask	cover;
+		int		rank;
+	};
+	Mask	m_targets; // uncovered ones
+	Mask	m_added;
+	StaticVector<Spot, Map::AREA> m_spots;
+	// gain, -rank, -index: the first added spot wins equal ranks
+	StaticPriorityQueue<tuple<int, int, int>, 2 * Map::AREA + 1> m_queue;
+};
+
+/* look for bridges */
+class Bridges {
+public:
+	Bridges(Map* map) :
+		m_map(map),
+		m_shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} }
+	{//default ctor
+	}
+	// @root: HQ of the side which owns @type
+	const BridgeList& GetBridges(Tile type, Vec2 root) noexcept {
+		this->Clear();
+
+		assert(m_bridges.empty());
+		this->Dfs(root, Vec2{ -1,-1 }, type);
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 v{ x, y };
+				if (!m_visited[y][x] && m_map->Get(v) == type)
+					this->Dfs(v, Vec2{ -1,-1 }, type);
+			}
+		}
+
+		return m_bridges;
+	}
+private:
+	void Dfs(Vec2 v, Vec2 p, Tile type) noexcept {
+		m_visited[v.y][v.x] = true;
+
+		m_start[v.y][v.x] = m_finish[v.y][v.x] = m_timer++;
+
+		for (auto& sh : m_shift) {
+			auto to{ v + sh };
+			if (!IsValid(to)) continue;
+			auto ty{ m_map->Get(to) };
+			if (type != ty || to == p) continue;
+			if (m_visited[to.y][to.x])
+				m_finish[v.y][v.x] = min(m_finish[v.y][v.x], m_start[to.y][to.x]);
+			else {
+				Dfs(to, v, type);
+				m_finish[v.y][v.x] = min(m_finish[v.y][v.x], m_finish[to.y][to.x]);
+				if (m_finish[to.y][to.x] > m_start[v.y][v.x])
+				{//found bridge
+				//	 cerr << "Bridge: " << v << " - " << to << endl;
+					m_bridges.emplace_back(v, to);
+				}
+			}
+		}
+	}
+	void Clear() noexcept {
+		for (int i = 0; i < Map::HEIGHT; i++) {
+			for (int j = 0; j < Map::WIDTH; j++) {
+				m_visited[i][j] = false;
+				m_start[i][j] = m_finish[i][j] = 0;
+			}
+		}
+		m_bridges.clear();
+		m_timer = 0;
+	}
+private:
+	BridgeList m_bridges;
+
+	array<Vec2, 4> m_shift;
+	bool	m_visited[Map::HEIGHT][Map::WIDTH];
+	int		m_start[Map::HEIGHT][Map::WIDTH];
+	int		m_finish[Map::HEIGHT][Map::WIDTH];
+	int		m_timer;
+
+	Map* m_map;
+};
+
+/* find components connected by bridge in the graph */
+class CCSearch {
+public:
+	CCSearch(Map*map, UnitManager* uManager, BuildingManager * bManager) :
+		m_map(map),
+		m_uManager(uManager),
+		m_bManager(bManager),
+		m_shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} }
+	{//default ctor
+	}
+
+	using Path = StaticVector<pair<Vec2, int>, Map::AREA>;
 
 	int GetScoreAfterBridge(Vec2 start, Vec2 bridge, Tile type) noexcept {
 		int score{ 0 };
@@ -542,7 +1616,7 @@ public:
 		auto modify = [&bridge, &from, &to, &map, &uManager](Vec2 v) {
 			bool is{ from == map->Get(v) };
 			if (is) {
-				map->m_map[v.y][v.x] = to;
+				map->Set(v, to);
 				//// remove units from manager!
 				//uManager->MarkUnitForRemove(v);
 				//cerr << "Marked: " << v << endl;
@@ -614,31 +1688,69 @@ public:
 		}
 	}
 	void Clear() noexcept {
-		for (int i = 0; i < Map::SIZE; i++) {
-			for (int j = 0; j < Map::SIZE; j++) {
+		for (int i = 0; i < Map::HEIGHT; i++) {
+			for (int j = 0; j < Map::WIDTH; j++) {
 				m_visited[i][j] = false;
 			}
 		}
 	}
 
+	struct Component {
+		int tiles{ 0 };
+		int towers{ 0 };
+		int mines{ 0 };
+	};
+	using Components = StaticVector<Component, Map::AREA>;
+	// bfs: label every connected component of @type, other tiles get -1
+	void LabelComponents(Tile type, int labels[Map::HEIGHT][Map::WIDTH], Components& components) {
+		this->Clear();
+		components.clear();
+		for (int i = 0; i < Map::HEIGHT; i++)
+			for (int j = 0; j < Map::WIDTH; j++)
+				labels[i][j] = -1;
+
+		RingQueue<Vec2, Map::AREA> Q;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (m_visited[y][x] || m_map->Get(Vec2{ x, y }) != type) continue;
+				int label{ static_cast<int>(components.size()) };
+				auto& component{ components.emplace_back() };
+				m_visited[y][x] = true;
+				Q.push(Vec2{ x, y });
+				while (!Q.empty()) {
+					auto top{ Q.front() };
+					Q.pop();
+					labels[top.y][top.x] = label;
+					component.tiles++;
+					auto optBuilding{ m_bManager->GetBuildingAt(top) };
+					if (optBuilding.has_value()) {
+						if (optBuilding->IsTower()) component.towers++;
+						else if (optBuilding->IsMine()) component.mines++;
+					}
+					for (auto& sh : m_shift) {
+						auto to{ top + sh };
+						if (IsValid(to) && !m_visited[to.y][to.x] && m_map->Get(to) == type) {
+							m_visited[to.y][to.x] = true;
+							Q.push(to);
+						}
+					}
+				}
+			}
+		}
+	}
+
 	// bfs: self-clearing
-	vector<pair<Vec2, int>> GetBoarderTiles(Tile type) {
+	TileList GetBoarderTiles(Tile type) {
 
 		this->Clear();
 
-		auto	mHQ = Vec2{ 0,0 }, 
-				eHQ = Vec2{ 11,11 };
-		if (m_map->Get(Vec2{ 0,0 }) == Tile::eActive)
-			swap(mHQ, eHQ);
-
-		Vec2 HQ{ type == Tile::mActive? mHQ : eHQ};
+		Vec2 HQ{ m_bManager->HQ(SideOf(type)) };
 	
 		m_visited[HQ.y][HQ.x] = true;
 
-		vector<pair<Vec2, int>> boarderTiles;
-		boarderTiles.reserve(10); //to avoid allocations
+		TileList boarderTiles;
 
-		queue<Vec2> Q;
+		RingQueue<Vec2, Map::AREA> Q;
 		Q.push(HQ);
 
 		while (!Q.empty()) {
@@ -662,277 +1774,2252 @@ public:
 				}
 			}
 		}
-
-		return boarderTiles;
+
+		return boarderTiles;
+	}
+
+	TileList GetOutline(Tile type) {
+		bool m_added[Map::HEIGHT][Map::WIDTH];
+		for (int i = 0; i < Map::HEIGHT; i++) {
+			for (int j = 0; j < Map::WIDTH; j++) {
+				m_visited[i][j] = m_added[i][j] = false;
+			}
+		}
+
+		Vec2 HQ{ m_bManager->HQ(SideOf(type)) };
+
+		m_visited[HQ.y][HQ.x] = true;
+
+		TileList boarderTiles;
+
+		RingQueue<Vec2, Map::AREA> Q;
+		Q.push(HQ);
+
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+
+			for (auto& sh : m_shift) {
+				auto tile{ top + sh };
+				if (IsValid(tile) &&
+					!m_visited[tile.y][tile.x] &&
+					m_map->Get(tile) != Tile::blocked)
+				{
+					if (m_map->Get(tile) == type) {
+						m_visited[tile.y][tile.x] = true;
+						Q.push(tile);
+					}
+					else if(!m_added[top.y][top.x]) {
+						boarderTiles.emplace_back(top, 0);
+						m_added[top.y][top.x] = true;
+					}
+				}
+			}
+		}
+
+		return boarderTiles;
+	}
+	// Dijkstra: has error when we're removing towers! 
+	// protected tiles still calculated!
+	// ****
+	// Look for cheapest path to enemy HQ and it's cost
+	// @S: side which trains the chain
+	template <class S>
+	int Cost(Vec2 pos) {
+		int cost{ 0 };
+		bool isProtected{ m_bManager->IsProtected(pos,*m_map) };
+		auto unit{ m_uManager->GetUnitAt(pos) };
+		if (m_map->Get(pos) == S::inactive) {
+			cost = 0;
+		}
+		else if (isProtected) {
+			cost = sd::costByLevel[2];
+		}
+		else if (unit.has_value()) {
+			cost = sd::costByLevel[min(unit->m_level + 1, 3) - 1];
+		}
+		else {
+			cost = sd::costByLevel[0];
+		}
+		return cost;
+	};
+	template <class S>
+	void FindPath(Vec2 start, Vec2 finish) {
+		this->ClearDijkstra();
+		 // calculate cost to conquire this tile
+
+		DijkstraPriority Q;
+		Q.emplace(start, start, 0);
+		m_cost[start.y][start.x] = 0;
+		while (!Q.empty()) {
+			auto top = Q.top();
+			Q.pop();
+
+			if (m_visited[top.position.y][top.position.x]) continue;
+
+			m_visited[top.position.y][top.position.x] = true;
+			m_parent[top.position.y][top.position.x] = top.parent;
+
+			if (top.position == finish) break;
+
+			for (auto shift : m_shift) {
+				Vec2 to{ shift + top.position };
+				if (!IsValid(to)) continue;
+				Tile type{ m_map->Get(to) };
+				if (type != Tile::blocked && type != S::active ) {
+					int cost = this->Cost<S>(to);
+					if (m_cost[to.y][to.x] > m_cost[top.position.y][top.position.x] + cost) {
+						m_cost[to.y][to.x] = m_cost[top.position.y][top.position.x] + cost;
+						Q.emplace(to, top.position, m_cost[to.y][to.x]);
+					}
+				}
+			}
+
+		}
+	}
+
+	Path GetPath(Vec2 start, Vec2 finish) const {
+		/*
+			Point<size_t> step = finish;
+			while (step != start) {
+				m_path.push_front(step);
+				step = m_parents[step.y][step.x];
+			}
+			m_path.push_front(start);
+		*/
+		Path path;
+		Vec2 step = finish;
+		while (step != start) {
+			Vec2 parent{ m_parent[step.y][step.x] };
+			int cost{ m_cost[step.y][step.x] - m_cost[parent.y][parent.x] };
+			path.emplace_back( step, cost / 10 );
+			step = m_parent[step.y][step.x];
+		}
+		reverse(path.begin(), path.end());
+		return path;
+	}
+
+	int GetCost(Vec2 finish) const noexcept {
+		return m_cost[finish.y][finish.x];
+	}
+
+
+//private:
+	struct Data {
+		Vec2	position;	//tile position
+		Vec2 	parent;		//tile from which we had came
+		int		cost;		//of the whole way: priority
+
+		Data() = default;
+		Data(Vec2 pos, Vec2 par, int c) :
+			position(pos), parent(par), cost(c) {}
+
+		friend bool operator <(const Data& t1, const Data&t2) {
+			return t1.cost < t2.cost;
+		}
+		friend bool operator >(const Data& t1, const Data&t2) {
+			return t1.cost > t2.cost;
+		}
+	};
+
+	// every relaxation pushes one entry: at most 4 per tile + start
+	using DijkstraPriority = StaticPriorityQueue<Data, 4 * Map::AREA + 1, greater<Data>>;
+
+	void ClearDijkstra() {
+		for (int i = 0; i < Map::HEIGHT; i++) {
+			for (int j = 0; j < Map::WIDTH; j++) {
+				m_visited[i][j] = false;
+				m_parent[i][j] = Vec2{-1,-1};
+				m_cost[i][j] = numeric_limits<int>::max();
+			}
+		}
+	}
+
+	array<Vec2, 4> m_shift;
+	bool m_visited[Map::HEIGHT][Map::WIDTH];
+	Vec2 m_parent[Map::HEIGHT][Map::WIDTH];
+	int  m_cost[Map::HEIGHT][Map::WIDTH];
+
+	Map* m_map;
+	UnitManager* m_uManager;
+	BuildingManager* m_bManager;
+};
+
+/* cheapest chains of trainings from every tile to one target, kept while tile costs change:
+ * a raised cost invalidates only the subtree which went through the tile and it's repaired
+ * from its border (Ramalingam-Reps), a lowered one is relaxed from the tile */
+class ChainTree {
+public:
+	static constexpr int INF{ numeric_limits<int>::max() / 2 };
+	// price to conquer a tile, INF if a chain can't pass through it
+	using Costs = array<array<int, Map::WIDTH>, Map::HEIGHT>;
+
+	bool IsBuilt(Vec2 root) const noexcept { return m_built && m_root == root; }
+	void Build(Vec2 root, const Costs& cost) noexcept {
+		m_root = root, m_cost = cost;
+		m_built = true;
+		for (auto& row : m_dist) row.fill(INF);
+		for (auto& row : m_parent) row.fill(Vec2{ -1, -1 });
+		Queue Q;
+		m_dist[root.y][root.x] = 0;
+		Q.emplace(0, root);
+		this->Relax(Q);
+	}
+	// @return number of tiles whose chain was repaired
+	int Update(const Costs& cost) noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		Grid<bool> affected{};
+		StaticVector<Vec2, Map::AREA> lost, lowered;
+		// chains through a raised tile are lost
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (cost[y][x] > m_cost[y][x]) this->CollectSubtree(Vec2{ x, y }, affected, lost);
+				else if (cost[y][x] < m_cost[y][x]) lowered.push_back(Vec2{ x, y });
+			}
+		}
+		m_cost = cost;
+		Queue Q;
+		for (auto p : lost) {
+			m_dist[p.y][p.x] = INF;
+			m_parent[p.y][p.x] = Vec2{ -1, -1 };
+		}
+		// the lost ones are reconnected through intact neighbors
+		for (auto p : lost) {
+			for (auto& sh : shift) {
+				auto from{ p + sh };
+				if (!IsValid(from) || affected[from.y][from.x]) continue;
+				this->Offer(from, p, Q);
+			}
+		}
+		for (auto p : lowered) {
+			for (auto& sh : shift) {
+				auto to{ p + sh };
+				if (IsValid(to)) this->Offer(p, to, Q);
+			}
+		}
+		this->Relax(Q);
+		return static_cast<int>(lost.size() + lowered.size());
+	}
+	// cost of the cheapest chain which starts next to @from: @from itself isn't conquered
+	int Distance(Vec2 from) const noexcept { return m_dist[from.y][from.x]; }
+	int Cost(Vec2 p) const noexcept { return m_cost[p.y][p.x]; }
+	Vec2 Root() const noexcept { return m_root; }
+	// tiles to train on and the levels, from the neighbor of @from to the target
+	CCSearch::Path Chain(Vec2 from) const noexcept {
+		CCSearch::Path path;
+		if (m_dist[from.y][from.x] >= INF) return path;
+		for (Vec2 step{ m_parent[from.y][from.x] }; IsValid(step); step = m_parent[step.y][step.x]) {
+			path.emplace_back(step, m_cost[step.y][step.x] / sd::costByLevel[0]);
+			if (step == m_root) break;
+		}
+		return path;
+	}
+private:
+	template <class T>
+	using Grid = array<array<T, Map::WIDTH>, Map::HEIGHT>;
+	// a tile is queued for every improvement of its distance
+	using Queue = StaticPriorityQueue<pair<int, Vec2>, 8 * Map::AREA + 1, greater<pair<int, Vec2>>>;
+
+	// @to goes through its neighbor @via
+	void Offer(Vec2 via, Vec2 to, Queue& Q) noexcept {
+		int price{ m_cost[via.y][via.x] };
+		if (to == m_root || price >= INF || m_dist[via.y][via.x] >= INF) return;
+		int dist{ m_dist[via.y][via.x] + price };
+		if (dist >= m_dist[to.y][to.x]) return;
+		m_dist[to.y][to.x] = dist;
+		m_parent[to.y][to.x] = via;
+		Q.emplace(dist, to);
+	}
+	void Relax(Queue& Q) noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		while (!Q.empty()) {
+			auto[dist, top] = Q.top();
+			Q.pop();
+			if (dist != m_dist[top.y][top.x]) continue;
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (IsValid(to)) this->Offer(top, to, Q);
+			}
+		}
+	}
+	// tiles whose chain goes through @p, @p itself keeps its distance
+	void CollectSubtree(Vec2 p, Grid<bool>& affected, StaticVector<Vec2, Map::AREA>& lost) const noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		RingQueue<Vec2, Map::AREA> Q;
+		Q.push(p);
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : shift) {
+				auto child{ top + sh };
+				if (!IsValid(child) || affected[child.y][child.x] || !(m_parent[child.y][child.x] == top)) continue;
+				affected[child.y][child.x] = true;
+				lost.push_back(child);
+				Q.push(child);
+			}
+		}
+	}
+
+	bool	m_built{ false };
+	Vec2	m_root{ -1, -1 };
+	Costs	m_cost;
+	Grid<int>	m_dist;
+	Grid<Vec2>	m_parent;
+};
+
+/* cheapest chain to the root of the tree which the economy allows: labels (tile, gold, income),
+ * a label with less gold and less income than another one on the same tile is dropped.
+ * Gold left by the tree distance bounds the search like A* */
+class ChainPlanner {
+public:
+	static const size_t MAX_LABELS{ 2048 };
+	static const size_t MAX_FRONT{ 8 }; // labels kept on one tile
+
+	struct Plan {
+		int cost{ -1 }; // gold spent, -1 if there is no chain
+		CCSearch::Path path; // tiles with levels, 0 for my inactive ones
+		bool walks{ false }; // the walker moves to the first tile instead of a training
+	};
+	// @walker: my unit standing on @from which didn't move this turn
+	Plan Find(Vec2 from, const Player& me, const optional<Unit>& walker, const ChainTree& tree) noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		Plan plan;
+		m_labels.clear();
+		for (auto& row : m_front)
+			for (auto& front : row) front.clear();
+
+		Queue Q;
+		m_labels.push_back(Label{ from, me.m_gold, me.m_income, -1, 0, false, false });
+		Q.emplace(tree.Distance(from), 0);
+		while (!Q.empty()) {
+			auto index{ Q.top().second };
+			Q.pop();
+			auto label{ m_labels[index] };
+			if (label.dead) continue;
+			if (label.tile == tree.Root()) {
+				this->Trace(index, plan);
+				plan.cost = me.m_gold - label.gold;
+				return plan;
+			}
+			for (auto& sh : shift) {
+				auto to{ label.tile + sh };
+				if (!IsValid(to) || tree.Cost(to) >= ChainTree::INF) continue;
+				int price{ tree.Cost(to) };
+				int level{ price / sd::costByLevel[0] };
+				// my inactive tile: the chain passes for free
+				Label next{ to, label.gold, label.income, static_cast<int>(index), level, false, false };
+				if (level > 0) {
+					next.gold -= price;
+					next.income += 1 - sd::salaryByLevel[level - 1];
+					if (label.parent < 0 && walker && walker->m_level >= level) 
+					{ // the unit conquers the tile itself: no price, no new upkeep
+						next.gold = label.gold, next.income = label.income + 1;
+						next.walked = true;
+					}
+					// as Player::CanCreateUnit: we must afford the upkeep next turn
+					if (next.gold < 0 || next.gold + next.income < 0) continue;
+				}
+				// even the cheapest chain from here is too expensive
+				if (tree.Distance(to) >= ChainTree::INF || tree.Distance(to) > next.gold) continue;
+				if (!this->Admit(next)) continue;
+				if (m_labels.size() == MAX_LABELS) return plan;
+				m_labels.push_back(next);
+				m_front[to.y][to.x].push_back(m_labels.size() - 1);
+				Q.emplace(me.m_gold - next.gold + tree.Distance(to), m_labels.size() - 1);
+			}
+		}
+		return plan;
+	}
+private:
+	struct Label {
+		Vec2	tile;
+		int		gold;
+		int		income;
+		int		parent; // index of label, -1 for the start
+		int		level;
+		bool	walked;
+		bool	dead; // dominated after it was queued
+	};
+	using Queue = StaticPriorityQueue<pair<int, size_t>, 4 * MAX_LABELS + 1, greater<pair<int, size_t>>>;
+
+	// false if @label is dominated, otherwise labels it dominates are dropped
+	bool Admit(const Label& label) noexcept {
+		auto& front{ m_front[label.tile.y][label.tile.x] };
+		for (auto i : front) {
+			if (m_labels[i].gold >= label.gold && m_labels[i].income >= label.income) return false;
+		}
+		front.erase(remove_if(front.begin(), front.end(), [&](size_t i) {
+			bool dominated{ label.gold >= m_labels[i].gold && label.income >= m_labels[i].income };
+			if (dominated) m_labels[i].dead = true;
+			return dominated;
+		}), front.end());
+		return front.size() < MAX_FRONT;
+	}
+	void Trace(size_t index, Plan& plan) const noexcept {
+		for (int i = static_cast<int>(index); m_labels[i].parent >= 0; i = m_labels[i].parent) {
+			plan.path.emplace_back(m_labels[i].tile, m_labels[i].level);
+			plan.walks |= m_labels[i].walked;
+		}
+		reverse(plan.path.begin(), plan.path.end());
+	}
+
+	StaticVector<Label, MAX_LABELS> m_labels;
+	array<array<StaticVector<size_t, MAX_FRONT>, Map::WIDTH>, Map::HEIGHT> m_front;
+};
+
+/* foe's cheapest chain of trainings from its active territory to HQ of the defender */
+class ChainThreat {
+public:
+	ChainThreat(Map* map, UnitManager* uManager, BuildingManager* bManager) :
+		m_map(map),
+		m_uManager(uManager),
+		m_bManager(bManager),
+		m_shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} }
+	{
+	}
+
+	struct Report {
+		int cost{ -1 }; // of the cheapest chain, -1 if it's over the budget
+		StaticVector<Vec2, Map::AREA> path; // tiles the enemy trains on, my HQ is the last
+		StaticVector<Vec2, Map::AREA> towers; // where to build to push the chain over the budget
+	};
+
+	// @S: defender, @budget: gold the foe can spend on its next turn, @gold: what the defender has for towers
+	template <class S>
+	Report Evaluate(int budget, int gold) noexcept {
+		using Foe = typename S::Foe;
+		Vec2 HQ{ m_bManager->HQ(S::owner) };
+		Report report;
+		this->BuildCosts<S>();
+		report.cost = this->Search<Foe>(HQ, budget);
+		if (report.cost < 0) return report;
+		this->Trace(HQ, report.path);
+		// greedy: the tower which raises the cheapest chain the most until no chain fits the budget
+		auto path{ report.path };
+		int cost{ report.cost };
+		while (report.towers.size() < static_cast<size_t>(gold / sd::towerCost)) {
+			StaticVector<Vec2, Map::AREA> spots;
+			for (Vec2 tile : path) {
+				for (auto spot : this->TowerSpotsFor<S>(tile)) {
+					if (find(spots.begin(), spots.end(), spot) == spots.end()) spots.push_back(spot);
+				}
+			}
+			int bestGain{ 0 };
+			Vec2 bestTower{ -1, -1 };
+			auto prices{ m_price };
+			for (Vec2 spot : spots) {
+				this->Protect<S>(spot);
+				int after{ this->Search<Foe>(HQ, budget) };
+				m_price = prices;
+				int gain{ after < 0 ? numeric_limits<int>::max() : after - cost };
+				if (gain >= bestGain) { // later spots are closer to the HQ
+					bestGain = gain;
+					bestTower = spot;
+				}
+			}
+			if (bestGain == 0) break;
+			this->Protect<S>(bestTower);
+			report.towers.push_back(bestTower);
+			cost = this->Search<Foe>(HQ, budget);
+			if (cost < 0) return report;
+			this->Trace(HQ, path);
+		}
+		report.towers.clear(); // can't stop it with towers
+		return report;
+	}
+private:
+	// what the foe of @S pays to conquer a tile, -1 if it can't be entered
+	template <class S>
+	void BuildCosts() noexcept {
+		using Foe = typename S::Foe;
+		int level[Map::HEIGHT][Map::WIDTH];
+		for (int i = 0; i < Map::HEIGHT; i++)
+			for (int j = 0; j < Map::WIDTH; j++)
+				level[i][j] = 0;
+		for (auto& u : m_uManager->m_units) {
+			if (S::Owns(u.m_owner)) level[u.m_pos.y][u.m_pos.x] = u.m_level;
+		}
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Tile ty{ m_map->Get(Vec2{ x, y }) };
+				int& price{ m_price[y][x] };
+				if (ty == Tile::blocked) price = -1;
+				else if (ty == Foe::active || ty == Foe::inactive) price = 0;
+				else if (level[y][x]) price = sd::costByLevel[min(level[y][x] + 1, 3) - 1];
+				else price = sd::costByLevel[0];
+			}
+		}
+		for (auto& b : m_bManager->m_buildings) {
+			if (S::Owns(b.m_owner) && b.IsTower() && m_map->Get(b.m_pos) == S::active) this->Protect<S>(b.m_pos);
+		}
+	}
+	// covered tiles cost the foe a level 3
+	template <class S>
+	void Protect(Vec2 tower) noexcept {
+		array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
+		const int protectedCost{ sd::costByLevel[2] }; // only level 3 can get there
+		for (auto& sh : shift) {
+			auto covered{ sh + tower };
+			if (!IsValid(covered) || m_map->Get(covered) != S::active) continue;
+			int& price{ m_price[covered.y][covered.x] };
+			price = max(price, protectedCost);
+		}
+	}
+	// empty active tiles of @S where a tower protects @tile
+	template <class S>
+	StaticVector<Vec2, 5> TowerSpotsFor(Vec2 tile) const noexcept {
+		array<Vec2, 5> shift{ Vec2{0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		StaticVector<Vec2, 5> spots;
+		if (m_map->Get(tile) != S::active) return spots;
+		for (auto& sh : shift) {
+			auto spot{ sh + tile };
+			if (!IsValid(spot) || m_map->Get(spot) != S::active) continue;
+			if (m_bManager->GetBuildingAt(spot).has_value() || m_bManager->IsMineSpot(spot)) continue;
+			if (m_uManager->GetUnitAt(spot).has_value()) continue;
+			spots.push_back(spot);
+		}
+		return spots;
+	}
+	// conquered tiles of the last search from the first one to @target
+	void Trace(Vec2 target, StaticVector<Vec2, Map::AREA>& path) const noexcept {
+		path.clear();
+		for (Vec2 step{ target }; m_cost[step.y][step.x] != 0; step = m_parent[step.y][step.x]) {
+			path.push_back(step);
+		}
+		reverse(path.begin(), path.end());
+	}
+	// multi-source dijkstra from active tiles of @S, nothing over @budget is expanded
+	template <class S>
+	int Search(Vec2 target, int budget) noexcept {
+		StaticPriorityQueue<pair<int, Vec2>, 4 * Map::AREA + Map::AREA, greater<pair<int, Vec2>>> Q;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				m_cost[y][x] = numeric_limits<int>::max();
+				if (m_map->Get(Vec2{ x, y }) == S::active) {
+					m_cost[y][x] = 0;
+					Q.emplace(0, Vec2{ x, y });
+				}
+			}
+		}
+		while (!Q.empty()) {
+			auto[cost, top] = Q.top();
+			Q.pop();
+			if (cost > m_cost[top.y][top.x]) continue;
+			if (top == target) return cost;
+			for (auto& sh : m_shift) {
+				auto to{ sh + top };
+				if (!IsValid(to) || m_price[to.y][to.x] < 0) continue;
+				int next{ cost + m_price[to.y][to.x] };
+				if (next > budget || next >= m_cost[to.y][to.x]) continue;
+				m_cost[to.y][to.x] = next;
+				m_parent[to.y][to.x] = top;
+				Q.emplace(next, to);
+			}
+		}
+		return -1;
+	}
+
+	Map* m_map;
+	UnitManager* m_uManager;
+	BuildingManager* m_bManager;
+	array<Vec2, 4> m_shift;
+	array<array<int, Map::WIDTH>, Map::HEIGHT> m_price;
+	int  m_cost[Map::HEIGHT][Map::WIDTH];
+	Vec2 m_parent[Map::HEIGHT][Map::WIDTH];
+};
+
+/* who stands on every tile: used to compare states cheaply */
+struct Occupancy {
+	void Build(const Data& data) noexcept {
+		for (auto& row : m_unit) row.fill(0);
+		for (auto& row : m_building) row.fill(0);
+		for (auto& u : data.m_uManager.m_units) {
+			m_unit[u.m_pos.y][u.m_pos.x] = static_cast<char>(u.m_owner * 4 + u.m_level);
+		}
+		for (auto& b : data.m_bManager.m_buildings) {
+			m_building[b.m_pos.y][b.m_pos.x] = static_cast<char>(b.m_owner * 3 + toInt(b.m_type) + 1);
+		}
+	}
+	// only cells of @changes are rebuilt
+	template <class Changes>
+	void Update(const Data& data, const Changes& changes) noexcept {
+		array<array<bool, Map::WIDTH>, Map::HEIGHT> dirty{};
+		for (auto p : changes) {
+			dirty[p.y][p.x] = true;
+			m_unit[p.y][p.x] = m_building[p.y][p.x] = 0;
+		}
+		for (auto& u : data.m_uManager.m_units) {
+			if (dirty[u.m_pos.y][u.m_pos.x])
+				m_unit[u.m_pos.y][u.m_pos.x] = static_cast<char>(u.m_owner * 4 + u.m_level);
+		}
+		for (auto& b : data.m_bManager.m_buildings) {
+			if (dirty[b.m_pos.y][b.m_pos.x])
+				m_building[b.m_pos.y][b.m_pos.x] = static_cast<char>(b.m_owner * 3 + toInt(b.m_type) + 1);
+		}
+	}
+	bool SameAt(const Occupancy& o, Vec2 p) const noexcept {
+		return	m_unit[p.y][p.x] == o.m_unit[p.y][p.x] &&
+				m_building[p.y][p.x] == o.m_building[p.y][p.x];
+	}
+
+	array<array<char, Map::WIDTH>, Map::HEIGHT> m_unit;
+	array<array<char, Map::WIDTH>, Map::HEIGHT> m_building;
+};
+
+/* analyses done on the predicted state.
+ * Each one is reusable only while the part of the state it depends on still matches. */
+struct PonderResult {
+	void Clear() noexcept {
+		m_hasBridges[0] = m_hasBridges[1] = false;
+		m_hasComponents = false;
+		for (int i = 0; i < Map::HEIGHT; i++) {
+			for (int j = 0; j < Map::WIDTH; j++) {
+				m_worth[0][i][j] = m_worth[1][i][j] = -1;
+			}
+		}
+	}
+	// tiles of @type and everything standing on them are the same
+	bool Matches(const Data& data, const Occupancy& occupancy, Tile type) const noexcept {
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 p{ x, y };
+				Tile predicted{ m_map.Get(p) }, actual{ data.m_map.Get(p) };
+				if (predicted != type && actual != type) continue;
+				if (predicted != actual || !occupancy.SameAt(m_occupancy, p)) return false;
+			}
+		}
+		return true;
+	}
+	// -1 if it wasn't calculated
+	int BridgeWorth(Vec2 bridge, Tile type) const noexcept {
+		return m_worth[SideOf(type)][bridge.y][bridge.x];
+	}
+	optional<CCSearch::Component> InactiveComponent(Vec2 p) const noexcept {
+		if (!m_hasComponents || m_labels[p.y][p.x] < 0) return nullopt;
+		return make_optional(m_components[m_labels[p.y][p.x]]);
+	}
+
+	// predicted state
+	Map			m_map;
+	Occupancy	m_occupancy;
+	// analyses: index 0 is my side, 1 is the enemy
+	bool		m_hasBridges[2];
+	BridgeList	m_bridges[2];
+	int			m_worth[2][Map::HEIGHT][Map::WIDTH];
+	bool		m_hasComponents;
+	int			m_labels[Map::HEIGHT][Map::WIDTH]; // my inactive components
+	CCSearch::Components m_components;
+};
+
+/* runs analyses on the predicted next state while we wait for input */
+class Ponderer {
+public:
+	Ponderer() :
+		m_search(&m_state.m_map, &m_state.m_uManager, &m_state.m_bManager),
+		m_bridges(&m_state.m_map),
+		m_worker([this]() { this->Work(); })
+	{
+	}
+	~Ponderer() {
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_quit = m_stop = true;
+		}
+		m_cv.notify_all();
+		m_worker.join();
+	}
+	// @played: state after our commands were applied, @steps: analyses done before it stops as if it was stopped
+	void Start(const Data& played, size_t steps = numeric_limits<size_t>::max()) {
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_state = played;
+			m_steps = steps;
+			m_state.m_me.m_gold += m_state.m_me.m_income;
+			m_state.m_enemy.m_gold += m_state.m_enemy.m_income;
+			m_stop = false;
+			m_hasJob = true;
+		}
+		m_cv.notify_all();
+	}
+	// interrupt pondering: result may be partial
+	const PonderResult* Stop() {
+		unique_lock<mutex> lock(m_mutex);
+		if (!m_hasJob && !m_busy && !m_started) return nullptr;
+		m_stop = true;
+		m_cv.wait(lock, [this]() { return !m_hasJob && !m_busy; });
+		return &m_result;
+	}
+	// waits until it stops by itself: done or out of steps
+	const PonderResult* Wait() {
+		unique_lock<mutex> lock(m_mutex);
+		m_cv.wait(lock, [this]() { return !m_hasJob && !m_busy; });
+		return m_started ? &m_result : nullptr;
+	}
+private:
+	void Work() {
+		unique_lock<mutex> lock(m_mutex);
+		while (true) {
+			m_cv.wait(lock, [this]() { return m_hasJob || m_quit; });
+			if (m_quit) return;
+			m_hasJob = false;
+			m_busy = m_started = true;
+			lock.unlock();
+			this->Analyse();
+			lock.lock();
+			m_busy = false;
+			m_cv.notify_all();
+		}
+	}
+	void Analyse() {
+		auto& result{ m_result };
+		auto& map{ m_state.m_map };
+		result.Clear();
+		result.m_map = map;
+		result.m_occupancy.Build(m_state);
+
+		Vec2 mHQ{ MySide::HQ(m_state) }, eHQ{ EnemySide::HQ(m_state) };
+
+		const Tile sides[2] = { Tile::mActive, Tile::eActive };
+		for (int side = 0; side < 2; side++) {
+			if (this->Stopped()) return;
+			result.m_bridges[side] = m_bridges.GetBridges(sides[side], side == 0 ? mHQ : eHQ);
+			result.m_hasBridges[side] = true;
+		}
+		for (int side = 0; side < 2; side++) {
+			Vec2 HQ{ side == 0 ? mHQ : eHQ };
+			for (const auto&[from, to] : result.m_bridges[side]) {
+				for (Vec2 bridge : { from, to }) {
+					if (this->Stopped()) return;
+					if (result.m_worth[side][bridge.y][bridge.x] >= 0) continue;
+					m_search.Clear();
+					result.m_worth[side][bridge.y][bridge.x] = m_search.GetScoreAfterBridge(HQ, bridge, sides[side]);
+				}
+			}
+		}
+		if (this->Stopped()) return;
+		m_search.LabelComponents(Tile::mInactive, result.m_labels, result.m_components);
+		result.m_hasComponents = true;
+	}
+
+	// checked before every analysis
+	bool Stopped() noexcept { return m_stop || m_steps-- == 0; }
+
+	Data			m_state;
+	PonderResult	m_result;
+	CCSearch		m_search;
+	Bridges			m_bridges;
+
+	mutex				m_mutex;
+	condition_variable	m_cv;
+	atomic<bool>		m_stop{ false };
+	size_t				m_steps{ 0 }; // left before it stops by itself
+	bool				m_quit{ false };
+	bool				m_hasJob{ false };
+	bool				m_busy{ false };
+	bool				m_started{ false };
+	thread				m_worker; // last: starts after everything above is built
+};
+
+/* small work-stealing pool: the caller is worker 0, with one worker everything runs inline.
+ * Every index gets its own result slot, so reduction in index order is deterministic. */
+class TaskPool {
+public:
+	explicit TaskPool(size_t workers) :
+		m_queues(max<size_t>(workers, 1))
+	{
+		for (size_t worker = 1; worker < m_queues.size(); worker++) {
+			m_threads.emplace_back([this, worker]() { this->Work(worker); });
+		}
+	}
+	~TaskPool() {
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_cv.notify_all();
+		for (auto& t : m_threads) t.join();
+	}
+
+	size_t Size() const noexcept { return m_queues.size(); }
+
+	// calls fn(index, worker) for each index in [0, count) and waits for all of them
+	template <class Fn>
+	void ParallelFor(size_t count, Fn& fn) {
+		static_assert(is_invocable_v<Fn, size_t, size_t>, "can't invoke task");
+		if (m_queues.size() == 1 || count < 2) {
+			for (size_t i = 0; i < count; i++) fn(i, 0);
+			return;
+		}
+		m_context = &fn;
+		m_invoke = [](void* context, size_t index, size_t worker) {
+			(*static_cast<Fn*>(context))(index, worker);
+		};
+		size_t workers{ m_queues.size() };
+		for (size_t worker = 0; worker < workers; worker++) {
+			auto& q{ m_queues[worker] };
+			lock_guard<mutex> lock(q.m_mutex);
+			q.m_begin = count * worker / workers;
+			q.m_end = count * (worker + 1) / workers;
+		}
+		m_remaining = count;
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_open = true;
+			m_generation++;
+		}
+		m_cv.notify_all();
+
+		this->Drain(0);
+		while (m_remaining.load() != 0) this_thread::yield();
+
+		unique_lock<mutex> lock(m_mutex);
+		m_open = false;
+		m_cv.wait(lock, [this]() { return m_active == 0; });
+	}
+private:
+	struct Queue {
+		mutex	m_mutex;
+		size_t	m_begin{ 0 };
+		size_t	m_end{ 0 };
+	};
+	// own tasks are taken from the front, stolen ones from the back
+	bool Pop(size_t worker, size_t& index) {
+		auto& own{ m_queues[worker] };
+		{
+			lock_guard<mutex> lock(own.m_mutex);
+			if (own.m_begin < own.m_end) {
+				index = own.m_begin++;
+				return true;
+			}
+		}
+		for (size_t shift = 1; shift < m_queues.size(); shift++) {
+			auto& victim{ m_queues[(worker + shift) % m_queues.size()] };
+			lock_guard<mutex> lock(victim.m_mutex);
+			if (victim.m_begin < victim.m_end) {
+				index = --victim.m_end;
+				return true;
+			}
+		}
+		return false;
+	}
+	void Drain(size_t worker) {
+		size_t index;
+		while (this->Pop(worker, index)) {
+			m_invoke(m_context, index, worker);
+			m_remaining--;
+		}
+	}
+	void Work(size_t worker) {
+		size_t seen{ 0 };
+		unique_lock<mutex> lock(m_mutex);
+		while (true) {
+			m_cv.wait(lock, [&]() { return m_quit || (m_open && m_generation != seen); });
+			if (m_quit) return;
+			seen = m_generation;
+			m_active++;
+			lock.unlock();
+			this->Drain(worker);
+			lock.lock();
+			m_active--;
+			m_cv.notify_all();
+		}
+	}
+
+	vector<Queue>	m_queues;
+	vector<thread>	m_threads;
+	void*			m_context{ nullptr };
+	void			(*m_invoke)(void*, size_t, size_t) { nullptr };
+	atomic<size_t>	m_remaining{ 0 };
+
+	mutex				m_mutex;
+	condition_variable	m_cv;
+	size_t				m_generation{ 0 };
+	size_t				m_active{ 0 };
+	bool				m_open{ false };
+	bool				m_quit{ false };
+};
+
+/* traversal scratch of one worker: engines run over a private copy of the map */
+struct Engines {
+	explicit Engines(Data* data) :
+		m_map{},
+		m_search(&m_map, &data->m_uManager, &data->m_bManager),
+		m_bridges(&m_map),
+		m_threat(&m_map, &data->m_uManager, &data->m_bManager)
+	{
+	}
+	Map			m_map;
+	CCSearch	m_search;
+	Bridges		m_bridges;
+	ChainThreat	m_threat;
+};
+
+/* part of the state a view is built from: bits index Data::Stamp */
+namespace depends
+{
+	const unsigned myTiles{ 1 << 0 };
+	const unsigned enemyTiles{ 1 << 1 };
+	const unsigned myUnits{ 1 << 2 };
+	const unsigned enemyUnits{ 1 << 3 };
+	const unsigned myBuildings{ 1 << 4 };
+	const unsigned enemyBuildings{ 1 << 5 };
+
+	constexpr unsigned Tiles(int side) noexcept { return side == 0 ? myTiles : enemyTiles; }
+	constexpr unsigned Units(int side) noexcept { return side == 0 ? myUnits : enemyUnits; }
+	constexpr unsigned Buildings(int side) noexcept { return side == 0 ? myBuildings : enemyBuildings; }
+	constexpr unsigned Side(int side) noexcept {
+		return Tiles(side) | Units(side) | Buildings(side);
+	}
+};
+
+/* value computed once and reused until a counter it depends on changes */
+template <class T>
+class Memo {
+public:
+	using Stamp = Data::Stamp;
+
+	bool IsValid(const Stamp& now, unsigned depends) const noexcept {
+		if (!m_valid) return false;
+		for (size_t i = 0; i < now.size(); i++) {
+			if ((depends & (1u << i)) && now[i] != m_stamp[i]) return false;
+		}
+		return true;
+	}
+	// @compute fills the value in place
+	template <class Compute>
+	T& Get(const Stamp& now, unsigned depends, Compute compute) {
+		if (!this->IsValid(now, depends)) {
+			compute(m_value);
+			m_stamp = now;
+			m_valid = true;
+		}
+		return m_value;
+	}
+	// @patch updates the stale value from the stamp it was built at, false if it can't
+	template <class Compute, class Patch>
+	T& Get(const Stamp& now, unsigned depends, Compute compute, Patch patch) {
+		if (!this->IsValid(now, depends)) {
+			if (!m_valid || !patch(m_value, m_stamp)) compute(m_value);
+			m_stamp = now;
+			m_valid = true;
+		}
+		return m_value;
+	}
+	// value if it was computed, maybe stale
+	T* Cached() noexcept { return m_valid ? &m_value : nullptr; }
+	void Invalidate() noexcept { m_valid = false; }
+private:
+	T		m_value{};
+	Stamp	m_stamp{};
+	bool	m_valid{ false };
+};
+
+/* fixed-size cache of query values by zobrist key shared by all workers:
+ * an entry is stored as (key ^ data, data), a torn write fails the check and reads as a miss */
+class TranspositionTable {
+public:
+	static constexpr size_t SIZE{ 1 << 14 };
+
+	optional<int> Find(zobrist::Key key) noexcept {
+		m_probes.fetch_add(1, memory_order_relaxed);
+		auto& entry{ m_entries[key & (SIZE - 1)] };
+		uint64_t data{ entry.m_data.load(memory_order_relaxed) };
+		uint64_t check{ entry.m_check.load(memory_order_relaxed) };
+		if (!(data & VALID) || (check ^ data) != key) return nullopt;
+		m_hits.fetch_add(1, memory_order_relaxed);
+		return static_cast<int>(static_cast<uint32_t>(data));
+	}
+	// always replaces: the latest turn's queries are the useful ones
+	void Store(zobrist::Key key, int value) noexcept {
+		auto& entry{ m_entries[key & (SIZE - 1)] };
+		uint64_t data{ VALID | static_cast<uint32_t>(value) };
+		entry.m_check.store(key ^ data, memory_order_relaxed);
+		entry.m_data.store(data, memory_order_relaxed);
+	}
+	size_t Probes() const noexcept { return m_probes.load(memory_order_relaxed); }
+	size_t Hits() const noexcept { return m_hits.load(memory_order_relaxed); }
+	void ResetCounters() noexcept {
+		m_probes.store(0, memory_order_relaxed);
+		m_hits.store(0, memory_order_relaxed);
+	}
+
+private:
+	static constexpr uint64_t VALID{ 1ull << 32 };
+	struct Entry {
+		atomic<uint64_t> m_check{ 0 };
+		atomic<uint64_t> m_data{ 0 };
+	};
+	unique_ptr<Entry[]> m_entries{ make_unique<Entry[]>(SIZE) };
+	atomic<size_t> m_probes{ 0 }, m_hits{ 0 };
+};
+
+/* lazily computed analyses shared by every phase of Commander, kept across turns.
+ * Views are rebuilt only when the tiles, units or buildings they depend on were mutated,
+ * local ones are patched around the touched positions when few of them changed. */
+class TurnAnalysis {
+public:
+	using BridgeScores = StaticVector<pair<int, Vec2>, Map::AREA>;
+
+	TurnAnalysis(Data* data, const StaticMap* tables, size_t workers = Config::threads) :
+		m_data(data),
+		m_static(tables),
+		m_pool(workers)
+	{
+		for (size_t worker = 0; worker < m_pool.Size(); worker++) {
+			m_engines.emplace_back(make_unique<Engines>(data));
+		}
+	}
+	// new turn: views of unchanged sides stay valid unless @rebuild is set
+	void Reset(const PonderResult* pondered, bool rebuild) noexcept {
+		m_HQ[0] = m_data->m_bManager.HQ(0), m_HQ[1] = m_data->m_bManager.HQ(1);
+		m_pondered = pondered;
+		if (m_table.Probes()) {
+			cerr << "TT: " << m_table.Hits() << "/" << m_table.Probes() << " hits" << endl;
+			m_table.ResetCounters();
+		}
+		// pondered worth was matched against the previous prediction
+		for (auto& cuts : m_cuts) {
+			if (auto cached{ cuts.Cached() }) cached->m_pondered = false;
+		}
+		if (!rebuild) return;
+		for (int side = 0; side < 2; side++) {
+			m_outline[side].Invalidate();
+			m_frontier[side].Invalidate();
+			m_bridges[side].Invalidate();
+			m_cuts[side].Invalidate();
+			m_threats[side].Invalidate();
+			m_inactive[side].Invalidate();
+		}
+		m_protection.Invalidate();
+		m_occupancy.Invalidate();
+	}
+
+	TaskPool& Pool() noexcept { return m_pool; }
+	TranspositionTable& Table() noexcept { return m_table; }
+	// engines of @worker synchronized with the current map
+	Engines& EnginesOf(size_t worker) noexcept {
+		auto& engines{ *m_engines[worker] };
+		engines.m_map = m_data->m_map;
+		return engines;
+	}
+	const PonderResult* Pondered() const noexcept { return m_pondered; }
+	bool IsPonderedValid(Tile type) {
+		return m_pondered && m_pondered->Matches(*m_data, this->OccupancyIndex(), type);
+	}
+	// owner and level of units, owner and type of buildings by tile
+	const Occupancy& OccupancyIndex() {
+		const unsigned all{ depends::myUnits | depends::enemyUnits | depends::myBuildings | depends::enemyBuildings };
+		return m_occupancy.Get(m_data->GetStamp(), all, [this](Occupancy& occupancy) {
+			occupancy.Build(*m_data);
+		}, [this](Occupancy& occupancy, const Data::Stamp& since) {
+			Data::Changes changes;
+			if (!m_data->ChangesSince(since, changes)) return false;
+			occupancy.Update(*m_data, changes);
+			return true;
+		});
+	}
+
+	// active tiles of @S which have a foreign neighbor
+	template <class S>
+	const TileList& Outline() {
+		return m_outline[S::owner].Get(m_data->GetStamp(), depends::Tiles(S::owner), [this](TileList& outline) {
+			if (!this->MirroredTiles(m_outline, S::owner, outline))
+				outline = this->EnginesOf(0).m_search.GetOutline(S::active);
+		});
+	}
+	// tiles around active territory of @S
+	template <class S>
+	const TileList& Frontier() {
+		return m_frontier[S::owner].Get(m_data->GetStamp(), depends::Tiles(S::owner), [this](TileList& frontier) {
+			if (!this->MirroredTiles(m_frontier, S::owner, frontier))
+				frontier = this->EnginesOf(0).m_search.GetBoarderTiles(S::active);
+		});
+	}
+	const BridgeList& Bridges(Tile type) {
+		return this->BuildBridges(SideOf(type), 0);
+	}
+	// both sides are independent: searched in parallel
+	void UpdateBridges() {
+		// or the second one is mirrored from the first one
+		if (m_static->MirrorsSides(m_data->m_map)) {
+			this->BuildBridges(0, 0);
+			this->BuildBridges(1, 0);
+			return;
+		}
+		auto task = [this](size_t side, size_t worker) {
+			this->BuildBridges(static_cast<int>(side), worker);
+		};
+		m_pool.ParallelFor(2, task);
+	}
+	// score of the CC which will be cut off by @bridge
+	int CutValue(Vec2 bridge, Tile type) {
+		auto& cuts{ this->CutsOf(type) };
+		int& worth{ cuts.m_worth[bridge.y][bridge.x] };
+		if (worth < 0) worth = this->ComputeCut(bridge, type, cuts.m_pondered, this->EnginesOf(0).m_search);
+		return worth;
+	}
+	// worth of every tile of @bridges in order of appearance, missing ones are scored in parallel
+	BridgeScores CutValues(const BridgeList& bridges, Tile type) {
+		auto& cuts{ this->CutsOf(type) };
+		bool added[Map::HEIGHT][Map::WIDTH];
+		for (int i = 0; i < Map::HEIGHT; i++)
+			for (int j = 0; j < Map::WIDTH; j++)
+				added[i][j] = false;
+
+		BridgeScores scores;
+		StaticVector<size_t, Map::AREA> missing;
+		for (const auto&[from, to] : bridges) {
+			for (Vec2 bridge : { from, to }) {
+				if (added[bridge.y][bridge.x]) continue;
+				added[bridge.y][bridge.x] = true;
+				if (cuts.m_worth[bridge.y][bridge.x] < 0) missing.push_back(scores.size());
+				scores.emplace_back(cuts.m_worth[bridge.y][bridge.x], bridge);
+			}
+		}
+		auto task = [&](size_t i, size_t worker) {
+			auto& score{ scores[missing[i]] };
+			score.first = this->ComputeCut(score.second, type, cuts.m_pondered, this->EnginesOf(worker).m_search);
+		};
+		m_pool.ParallelFor(missing.size(), task);
+		for (auto[worth, bridge] : scores) {
+			cuts.m_worth[bridge.y][bridge.x] = worth;
+		}
+		return scores;
+	}
+	// min and max level of units of the foe of @S around @p, {-1,-1} if there are none
+	template <class S>
+	pair<int, int> FoeLevelsAround(Vec2 p) {
+		using Foe = typename S::Foe;
+		const unsigned foe{ depends::Tiles(Foe::owner) | depends::Units(Foe::owner) };
+		auto& threats{ m_threats[S::owner].Get(m_data->GetStamp(), foe, [this](Threats& threats) {
+			this->BuildThreats<Foe>(threats, nullptr);
+		}, [this](Threats& threats, const Data::Stamp& since) {
+			auto around{ this->AroundChanges(since) };
+			if (around) this->BuildThreats<Foe>(threats, &around.value());
+			return around.has_value();
+		}) };
+		return { threats.m_min[p.y][p.x], threats.m_max[p.y][p.x] };
+	}
+	// tile is covered by the tower of its owner
+	bool IsProtected(Vec2 p) {
+		const unsigned all{ depends::myTiles | depends::enemyTiles | depends::myBuildings | depends::enemyBuildings };
+		auto& protection{ m_protection.Get(m_data->GetStamp(), all, [this](Grid<bool>& protection) {
+			this->BuildProtection(protection, nullptr);
+		}, [this](Grid<bool>& protection, const Data::Stamp& since) {
+			auto around{ this->AroundChanges(since) };
+			if (around) this->BuildProtection(protection, &around.value());
+			return around.has_value();
+		}) };
+		return protection[p.y][p.x];
+	}
+	// inactive component of @S which contains @p
+	template <class S>
+	optional<CCSearch::Component> InactiveComponent(Vec2 p) {
+		const unsigned own{ depends::Tiles(S::owner) | depends::Buildings(S::owner) };
+		auto& inactive{ m_inactive[S::owner].Get(m_data->GetStamp(), own, [this](Labels& inactive) {
+			// only my components are pondered
+			if (S::owner == 0 && m_pondered && m_pondered->m_hasComponents && this->IsPonderedValid(S::inactive)) {
+				for (int i = 0; i < Map::HEIGHT; i++)
+					for (int j = 0; j < Map::WIDTH; j++)
+						inactive.m_labels[i][j] = m_pondered->m_labels[i][j];
+				inactive.m_components = m_pondered->m_components;
+			}
+			else {
+				this->EnginesOf(0).m_search.LabelComponents(S::inactive, inactive.m_labels, inactive.m_components);
+			}
+		}, [this](Labels& inactive, const Data::Stamp& since) {
+			// components are untouched unless an inactive tile, before or after, was changed
+			Data::Changes changes;
+			if (!m_data->ChangesSince(since, changes)) return false;
+			auto& map{ m_data->m_map };
+			return none_of(changes.begin(), changes.end(), [&](Vec2 p) {
+				return inactive.m_labels[p.y][p.x] >= 0 || map.Get(p) == S::inactive;
+			});
+		}) };
+		int label{ inactive.m_labels[p.y][p.x] };
+		return label < 0 ? nullopt : make_optional(inactive.m_components[label]);
+	}
+private:
+	template <class T>
+	using Grid = array<array<T, Map::WIDTH>, Map::HEIGHT>;
+	struct Threats {
+		Grid<int> m_min;
+		Grid<int> m_max;
+	};
+	struct Labels {
+		int m_labels[Map::HEIGHT][Map::WIDTH];
+		CCSearch::Components m_components;
+	};
+	// -1 for bridges which wasn't scored yet
+	struct Cuts {
+		int		m_worth[Map::HEIGHT][Map::WIDTH];
+		bool	m_pondered;
+	};
+
+	const BridgeList& BuildBridges(int side, size_t worker) {
+		Tile type{ side == 0 ? Tile::mActive : Tile::eActive };
+		unsigned tiles{ side == 0 ? depends::myTiles : depends::enemyTiles };
+		return m_bridges[side].Get(m_data->GetStamp(), tiles, [&](BridgeList& bridges) {
+			if (m_pondered && m_pondered->m_hasBridges[side] && this->IsPonderedValid(type))
+				bridges = m_pondered->m_bridges[side];
+			else if (auto twin{ this->MirrorOf(m_bridges, side) }) {
+				bridges.clear();
+				for (auto[from, to] : *twin) 
+					bridges.emplace_back(m_static->Mirror(from), m_static->Mirror(to));
+			}
+			else 
+				bridges = this->EnginesOf(worker).m_bridges.GetBridges(type, m_HQ[side]);
+		});
+	}
+	// view of the other side when the territories mirror each other
+	template <class T>
+	const T* MirrorOf(Memo<T> (&views)[2], int side) {
+		int other{ 1 - side };
+		if (!views[other].IsValid(m_data->GetStamp(), depends::Tiles(other))) return nullptr;
+		if (!m_static->MirrorsSides(m_data->m_map)) return nullptr;
+		return views[other].Cached();
+	}
+	// outline and frontier tiles of the other side mirrored
+	const TileList* MirroredTiles(Memo<TileList> (&views)[2], int side, TileList& tiles) {
+		auto twin{ this->MirrorOf(views, side) };
+		if (!twin) return nullptr;
+		tiles.clear();
+		for (auto[tile, score] : *twin) 
+			tiles.emplace_back(m_static->Mirror(tile), score);
+		return &tiles;
+	}
+	Cuts& CutsOf(Tile type) {
+		assert(SideOf(type) >= 0);
+		int side{ max(SideOf(type), 0) };
+		return m_cuts[side].Get(m_data->GetStamp(), depends::Side(side), [&](Cuts& cuts) {
+			for (int i = 0; i < Map::HEIGHT; i++)
+				for (int j = 0; j < Map::WIDTH; j++)
+					cuts.m_worth[i][j] = -1;
+			cuts.m_pondered = this->IsPonderedValid(type);
+		});
+	}
+	int ComputeCut(Vec2 bridge, Tile type, bool reusePondered, CCSearch& search) noexcept {
+		if (reusePondered) {
+			int worth{ m_pondered->BridgeWorth(bridge, type) };
+			if (worth >= 0) return worth;
+		}
+		auto key{ m_data->Hash() ^ zobrist::OfQuery(bridge, zobrist::CUT, SideOf(type)) };
+		if (auto worth{ m_table.Find(key) }) return *worth;
+		search.Clear();
+		int worth{ search.GetScoreAfterBridge(m_HQ[SideOf(type)], bridge, type) };
+		m_table.Store(key, worth);
+		return worth;
+	}
+	// touched positions and their neighbors, nullopt when there are too many to patch
+	optional<Grid<bool>> AroundChanges(const Data::Stamp& since) const noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		Data::Changes changes;
+		if (!m_data->ChangesSince(since, changes)) return nullopt;
+		Grid<bool> around{};
+		for (auto p : changes) {
+			around[p.y][p.x] = true;
+			for (auto& sh : shift) {
+				auto neighbor{ sh + p };
+				if (IsValid(neighbor)) around[neighbor.y][neighbor.x] = true;
+			}
+		}
+		return around;
+	}
+	// levels of units standing on active tiles of @S, only cells of @only are rebuilt, all if it's null
+	template <class S>
+	void BuildThreats(Threats& threats, const Grid<bool>* only) const noexcept {
+		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+		auto& map{ m_data->m_map };
+		Grid<int> level;
+		for (auto& row : level) row.fill(0);
+		// the first unit found on the tile counts, as in UnitManager::GetUnitAt
+		auto& units{ m_data->m_uManager.m_units };
+		for (auto it = units.rbegin(); it != units.rend(); ++it) {
+			level[it->m_pos.y][it->m_pos.x] = it->m_level;
+		}
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (only && !(*only)[y][x]) continue;
+				int mn = 1000, mx = -1;
+				for (auto& sh : shift) {
+					auto neighbor{ sh + Vec2{ x, y } };
+					if (IsValid(neighbor) && map.Get(neighbor) == S::active && level[neighbor.y][neighbor.x]) {
+						mn = min(level[neighbor.y][neighbor.x], mn);
+						mx = max(level[neighbor.y][neighbor.x], mx);
+					}
+				}
+				if (mn == 1000 && mx == -1) { mn = -1, mx = -1; }
+				threats.m_min[y][x] = mn;
+				threats.m_max[y][x] = mx;
+			}
+		}
+	}
+	// tile is covered by a tower standing on it or next to it on the same kind of tile
+	void BuildProtection(Grid<bool>& protection, const Grid<bool>* only) const noexcept {
+		array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
+		auto& map{ m_data->m_map };
+		Grid<bool> tower{};
+		for (auto& b : m_data->m_bManager.m_buildings) {
+			if (b.IsTower()) tower[b.m_pos.y][b.m_pos.x] = true;
+		}
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (only && !(*only)[y][x]) continue;
+				Vec2 p{ x, y };
+				protection[y][x] = any_of(shift.begin(), shift.end(), [&](Vec2 sh) {
+					auto t{ sh + p };
+					return IsValid(t) && tower[t.y][t.x] && map.Get(t) == map.Get(p);
+				});
+			}
+		}
+	}
+
+	Data*		m_data;
+	const StaticMap* m_static;
+	Vec2		m_HQ[2];
+	const PonderResult* m_pondered{ nullptr };
+	TranspositionTable	m_table;
+
+	// index is the side a view is built for
+	Memo<TileList>		m_outline[2];
+	Memo<TileList>		m_frontier[2];
+	Memo<BridgeList>	m_bridges[2];
+	Memo<Cuts>			m_cuts[2];
+	Memo<Threats>		m_threats[2];
+	Memo<Grid<bool>>	m_protection;
+	Memo<Labels>		m_inactive[2];
+	Memo<Occupancy>		m_occupancy;
+
+	TaskPool m_pool;
+	vector<unique_ptr<Engines>> m_engines; // one per worker
+};
+
+/* tiles and units after a plan: what the planners of both sides exchange */
+struct Board {
+	template <class T>
+	using Grid = array<array<T, Map::WIDTH>, Map::HEIGHT>;
+
+	Grid<Tile>	tiles;
+	Grid<int>	units; // level, negative for units of the other side
+
+	// as the side @owner sees @data
+	static Board Of(const Data& data, int owner) noexcept {
+		Board board;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				board.tiles[y][x] = data.m_map.Get(Vec2{ x, y });
+				board.units[y][x] = 0;
+			}
+		}
+		for (auto& u : data.m_uManager.m_units) {
+			board.units[u.m_pos.y][u.m_pos.x] = u.m_owner == owner ? u.m_level : -u.m_level;
+		}
+		return board;
+	}
+	// the same seen by the other side
+	Board Flipped() const noexcept {
+		Board board{ *this };
+		for (auto& row : board.units)
+			for (auto& level : row) level = -level;
+		return board;
+	}
+	// @active tiles connected to @root without @cut
+	void Reach(Tile active, Vec2 root, Vec2 cut, Grid<bool>& reached) const noexcept {
+		const array<Vec2, 4> shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
+		if (tiles[root.y][root.x] != active) return;
+		RingQueue<Vec2, Map::AREA> Q;
+		Q.push(root);
+		reached[root.y][root.x] = true;
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || to == cut || reached[to.y][to.x] || tiles[to.y][to.x] != active) continue;
+				reached[to.y][to.x] = true;
+				Q.push(to);
+			}
+		}
+	}
+	// cheapest chain of trainings from the territory of @S to @foeHQ, the economy aside
+	template <class S, class Guard>
+	int ChainCost(Vec2 foeHQ, Guard isProtected) const noexcept {
+		const array<Vec2, 4> shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
+		Grid<int> cost;
+		for (auto& row : cost) row.fill(numeric_limits<int>::max());
+		StaticPriorityQueue<pair<int, Vec2>, 4 * Map::AREA + 1, greater<pair<int, Vec2>>> Q;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (tiles[y][x] != S::active) continue;
+				cost[y][x] = 0;
+				Q.emplace(0, Vec2{ x, y });
+			}
+		}
+		while (!Q.empty()) {
+			auto[dist, top] { Q.top() };
+			Q.pop();
+			if (top == foeHQ) return dist;
+			if (dist > cost[top.y][top.x]) continue;
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || tiles[to.y][to.x] == Tile::blocked || tiles[to.y][to.x] == S::active) continue;
+				int enemyLevel{ max(-units[to.y][to.x], 0) };
+				int level{ isProtected(to) ? 3 : min(enemyLevel + 1, 3) };
+				int next{ dist + sd::costByLevel[level - 1] };
+				if (next >= cost[to.y][to.x]) continue;
+				cost[to.y][to.x] = next;
+				Q.emplace(next, to);
+			}
+		}
+		return numeric_limits<int>::max();
+	}
+	/* a unit of @S (seen as positive) comes to @pos: its inactive territory around is connected again,
+	 * the foe's territory cut off from @foeHQ is deactivated and units on it die */
+	template <class S>
+	void Conquer(Vec2 pos, int level, Vec2 foeHQ) noexcept {
+		using Foe = typename S::Foe;
+		const array<Vec2, 4> shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
+		auto type{ tiles[pos.y][pos.x] };
+		tiles[pos.y][pos.x] = S::active;
+		units[pos.y][pos.x] = level;
+		RingQueue<Vec2, Map::AREA> Q;
+		Q.push(pos);
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || tiles[to.y][to.x] != S::inactive) continue;
+				tiles[to.y][to.x] = S::active;
+				Q.push(to);
+			}
+		}
+		if (type != Foe::active) return;
+		Grid<bool> reached{};
+		this->Reach(Foe::active, foeHQ, Vec2{ -1, -1 }, reached);
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				if (tiles[y][x] != Foe::active || reached[y][x]) continue;
+				tiles[y][x] = Foe::inactive;
+				if (units[y][x] < 0) units[y][x] = 0;
+			}
+		}
+	}
+};
+
+/* sequences of trainings searched depth by depth: only the best states of a depth survive.
+ * A child is scored by the gain of its last training computed on its parent,
+ * states reached by the same trainings in another order are merged by zobrist key */
+template <class S>
+class TrainBeam {
+	using Foe = typename S::Foe;
+public:
+	template <class T>
+	using Grid = array<array<T, Map::WIDTH>, Map::HEIGHT>;
+	using Clock = chrono::steady_clock;
+	static const size_t MAX_WIDTH{ 32 };
+	static const size_t MAX_DEPTH{ 24 };
+	static const size_t MAX_PLANS{ 4 };
+	// a plan may lose as much as two level-2 trainings before its cut pays
+	static constexpr int MAX_LOSS{ 2 * sd::costByLevel[1] };
+
+	struct Train {
+		Vec2	pos;
+		int		level;
+	};
+	struct Plan {
+		int		score{ 0 }; // gains minus costs of the trainings
+		StaticVector<Train, MAX_DEPTH> trains;
+		Board	board; // after the trainings: cut and reconnected territory
+		Player	me; // after the trainings
+	};
+	// the best first, the empty plan is one of them
+	using Plans = StaticVector<Plan, MAX_PLANS>;
+
+	// @board: seen by @S, buildings are taken from @data
+	// @skip: tiles which mustn't be trained on
+	Plans Search(const Data& data, const Board& board, const Player& me, const StaticMap& tables, 
+		const Grid<bool>& skip, Clock::time_point deadline) noexcept 
+	{
+		auto start{ Clock::now() };
+		m_tables = &tables;
+		m_skip = &skip;
+		m_HQ = S::HQ(data), m_eHQ = Foe::HQ(data);
+		m_expanded = 0;
+		m_width = MAX_WIDTH / 4;
+		this->SetBuildings(data);
+
+		auto& root{ m_beam[0] };
+		root.board = board;
+		root.me = me;
+		root.score = 0;
+		root.key = 0;
+		root.won = false;
+		root.trains.clear();
+		m_top.clear();
+		m_top.push_back(root);
+		m_size = 1;
+
+		for (size_t depth = 0; depth < MAX_DEPTH && m_size > 0; depth++) {
+			m_children.clear();
+			for (size_t i = 0; i < m_size; i++) {
+				if (!m_beam[i].won) this->Expand(i);
+			}
+			m_expanded += m_size;
+			this->Select();
+			auto now{ Clock::now() };
+			if (now >= deadline) break;
+			// as wide as the time left allows for the depths which gold can still pay for
+			auto perState{ (now - start) / max<size_t>(m_expanded, 1) };
+			size_t depths{ static_cast<size_t>(max(m_top.front().me.m_gold / sd::costByLevel[0], 1)) };
+			auto affordable{ (deadline - now).count() / max<Clock::duration::rep>((perState * depths).count(), 1) };
+			m_width = static_cast<size_t>(clamp<Clock::duration::rep>(affordable, 1, MAX_WIDTH));
+		}
+		Plans plans;
+		for (auto& state : m_top) {
+			plans.push_back(Plan{ state.score, state.trains, state.board, state.me });
+		}
+		return plans;
+	}
+	// cheapest chain of trainings from the territory of @S to the foe HQ, the economy aside
+	int ChainCost(const Data& data, const Board& board) noexcept {
+		m_HQ = S::HQ(data), m_eHQ = Foe::HQ(data);
+		this->SetBuildings(data);
+		State state;
+		state.board = board;
+		return board.template ChainCost<S>(m_eHQ, [&](Vec2 p) { return this->IsProtected(state, p); });
+	}
+	size_t Width() const noexcept { return m_width; }
+	size_t Expanded() const noexcept { return m_expanded; }
+
+private:
+	struct State {
+		Board		board;
+		Player		me;
+		int			score;
+		zobrist::Key key; // of the trainings made
+		bool		won; // the enemy HQ is taken
+		StaticVector<Train, MAX_DEPTH> trains;
+	};
+	struct Child {
+		int		score;
+		int		order; // the nearer to the enemy HQ the better
+		zobrist::Key key;
+		size_t	parent;
+		Train	train;
+	};
+	using Queue = RingQueue<Vec2, Map::AREA>;
+
+	void SetBuildings(const Data& data) noexcept {
+		for (auto& row : m_building)
+			for (auto& b : row) b = Building{ -1, BType::HQ, Vec2{ -1, -1 } };
+		for (auto& b : data.m_bManager.m_buildings) {
+			m_building[b.m_pos.y][b.m_pos.x] = b;
+		}
+	}
+	// score the trainings on the frontier of the state
+	void Expand(size_t index) noexcept {
+		const State& state{ m_beam[index] };
+		Grid<bool> visited{};
+		Queue Q;
+		Q.push(m_HQ);
+		visited[m_HQ.y][m_HQ.x] = true;
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : m_shift) {
+				auto tile{ top + sh };
+				if (!IsValid(tile) || visited[tile.y][tile.x] || state.board.tiles[tile.y][tile.x] == Tile::blocked) continue;
+				visited[tile.y][tile.x] = true;
+				if (state.board.tiles[tile.y][tile.x] == S::active) Q.push(tile);
+				else this->AddChild(index, tile);
+			}
+		}
+	}
+	void AddChild(size_t index, Vec2 tile) noexcept {
+		const State& state{ m_beam[index] };
+		auto& me{ state.me };
+		if ((*m_skip)[tile.y][tile.x] || state.board.units[tile.y][tile.x] > 0) return;
+		if (m_children.size() == m_children.capacity()) return;
+		if (tile == m_eHQ) {
+			if (!me.CanCreateUnit(1, 1)) return;
+			m_children.push_back(Child{ state.score + sd::mxScore - sd::costByLevel[0], 0,
+				state.key ^ zobrist::OfUnit(tile, S::owner, 1), index, Train{ tile, 1 } });
+			return;
+		}
+		int enemyLevel{ max(-state.board.units[tile.y][tile.x], 0) };
+		int level{ this->IsProtected(state, tile) ? 3 : min(enemyLevel + 1, 3) };
+		if (!me.CanCreateUnit(level, 1)) return;
+
+		int gain{ sd::defaultScore };
+		auto type{ state.board.tiles[tile.y][tile.x] };
+		if (type == Foe::active) gain = this->CutScore(state, tile);
+		else if (type == Foe::inactive) gain = this->TileScore(state, tile, type);
+		gain += this->ReconnectScore(state, tile);
+		// as the greedy attack: level 3 only when the economy is strong, or the cut pays it twice
+		bool isEnough{ (me.m_gold > 45 && me.m_income > 30) || me.m_gold >= 90 };
+		if (level == 3 && !isEnough && gain <= 2 * sd::costByLevel[2]) return;
+		int score{ state.score + gain - sd::costByLevel[level - 1] };
+		// a step which doesn't pay itself may lead to a cut which does: the loss of the plan is bounded,
+		// a neutral tile is only a way to the foe
+		if (gain <= sd::costByLevel[level - 1] && (score < -MAX_LOSS || (type == Tile::neutral && !this->TouchesFoe(state, tile)))) return;
+		m_children.push_back(Child{ score, m_tables->FromHQ(Foe::owner, tile),
+			state.key ^ zobrist::OfUnit(tile, S::owner, level), index, Train{ tile, level } });
+	}
+	// keep the best child of every key, then the best of them
+	void Select() noexcept {
+		auto byKey = [](const Child& lhs, const Child& rhs) {
+			return tie(lhs.key, rhs.score, lhs.order) < tie(rhs.key, lhs.score, rhs.order);
+		};
+		sort(m_children.begin(), m_children.end(), byKey);
+		m_children.erase(unique(m_children.begin(), m_children.end(), [](const Child& lhs, const Child& rhs) {
+			return lhs.key == rhs.key;
+		}), m_children.end());
+		size_t width{ min(m_width, m_children.size()) };
+		partial_sort(m_children.begin(), m_children.begin() + width, m_children.end(), [](const Child& lhs, const Child& rhs) {
+			return tie(rhs.score, lhs.order, lhs.key) < tie(lhs.score, rhs.order, rhs.key);
+		});
+		for (size_t i = 0; i < width; i++) {
+			auto& child{ m_children[i] };
+			auto& next{ m_next[i] };
+			next = m_beam[child.parent];
+			this->Apply(next, child.train);
+			next.score = child.score;
+			next.key = child.key;
+			this->Keep(next);
+		}
+		swap(m_beam, m_next);
+		m_size = width;
+	}
+	// among the best states found so far
+	void Keep(const State& state) noexcept {
+		if (m_top.size() == MAX_PLANS && state.score <= m_top.back().score) return;
+		if (any_of(m_top.begin(), m_top.end(), [&state](const State& top) { return top.key == state.key; })) return;
+		if (m_top.size() == MAX_PLANS) m_top.pop_back();
+		m_top.push_back(state);
+		// earlier found is better on ties: it has fewer trainings
+		for (size_t i = m_top.size() - 1; i > 0 && m_top[i].score > m_top[i - 1].score; i--) {
+			swap(m_top[i], m_top[i - 1]);
+		}
+	}
+	void Apply(State& state, Train train) noexcept {
+		auto[pos, level] { train };
+		state.me.CreateUnit(level, 1);
+		state.trains.push_back(train);
+		state.board.template Conquer<S>(pos, level, m_eHQ);
+		if (pos == m_eHQ) state.won = true;
+	}
+	// as CCSearch::GetScoreAfterBridge: @tile and what is cut off with it
+	int CutScore(const State& state, Vec2 tile) const noexcept {
+		Grid<bool> reached{};
+		state.board.Reach(Foe::active, m_eHQ, tile, reached);
+		int score{ 0 };
+		Queue Q;
+		Q.push(tile);
+		reached[tile.y][tile.x] = true;
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			score += this->TileScore(state, top, Foe::active);
+			for (auto& sh : m_shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || reached[to.y][to.x] || state.board.tiles[to.y][to.x] != Foe::active) continue;
+				reached[to.y][to.x] = true;
+				Q.push(to);
+			}
+		}
+		return score;
+	}
+	int TileScore(const State& state, Vec2 p, Tile type) const noexcept {
+		int score{ type == Foe::active ? sd::activeTileScore : sd::inactiveTileScore };
+		auto& b{ m_building[p.y][p.x] };
+		if (b.m_owner == Foe::owner) score += b.IsTower() ? sd::towerCost : sd::minMineCost;
+		else if (state.board.units[p.y][p.x] < 0) score += sd::costByLevel[-state.board.units[p.y][p.x] - 1];
+		return score;
+	}
+	// towers and mines of my inactive territory which @tile connects
+	int ReconnectScore(const State& state, Vec2 tile) const noexcept {
+		Grid<bool> visited{};
+		int score{ 0 };
+		Queue Q;
+		Q.push(tile);
+		visited[tile.y][tile.x] = true;
+		while (!Q.empty()) {
+			auto top{ Q.front() };
+			Q.pop();
+			for (auto& sh : m_shift) {
+				auto to{ top + sh };
+				if (!IsValid(to) || visited[to.y][to.x] || state.board.tiles[to.y][to.x] != S::inactive) continue;
+				visited[to.y][to.x] = true;
+				auto& b{ m_building[to.y][to.x] };
+				if (b.m_owner == S::owner) score += b.IsTower() ? sd::towerCost : b.IsMine() ? sd::minMineCost : 0;
+				Q.push(to);
+			}
+		}
+		return score;
+	}
+	bool TouchesFoe(const State& state, Vec2 p) const noexcept {
+		return any_of(m_shift.begin(), m_shift.end(), [&](Vec2 sh) {
+			auto t{ p + sh };
+			return IsValid(t) && SideOf(state.board.tiles[t.y][t.x]) == Foe::owner;
+		});
+	}
+	// covered by a tower of the foe standing on it or next to it on the same kind of tile
+	bool IsProtected(const State& state, Vec2 p) const noexcept {
+		if (SideOf(state.board.tiles[p.y][p.x]) != Foe::owner) return false;
+		array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
+		return any_of(shift.begin(), shift.end(), [&](Vec2 sh) {
+			auto t{ sh + p };
+			return IsValid(t) && m_building[t.y][t.x].m_owner == Foe::owner && m_building[t.y][t.x].IsTower() &&
+				state.board.tiles[t.y][t.x] == state.board.tiles[p.y][p.x];
+		});
 	}
 
-	vector<pair<Vec2, int>> GetOutline(Tile type) {
-		bool m_added[Map::SIZE][Map::SIZE];
-		for (int i = 0; i < Map::SIZE; i++) {
-			for (int j = 0; j < Map::SIZE; j++) {
-				m_visited[i][j] = m_added[i][j] = false;
-			}
-		}
-
-		auto	mHQ = Vec2{ 0,0 },
-				eHQ = Vec2{ 11,11 };
-		if (m_map->Get(Vec2{ 0,0 }) == Tile::eActive)
-			swap(mHQ, eHQ);
-
-		Vec2 HQ{ type == Tile::mActive ? mHQ : eHQ };
-
-		m_visited[HQ.y][HQ.x] = true;
+	const array<Vec2, 4> m_shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
+	const StaticMap* m_tables{ nullptr };
+	const Grid<bool>* m_skip{ nullptr };
+	Vec2	m_HQ, m_eHQ;
+	Grid<Building> m_building;
+	array<State, MAX_WIDTH> m_beam, m_next;
+	size_t	m_size{ 0 };
+	StaticVector<State, MAX_PLANS> m_top;
+	StaticVector<Child, MAX_WIDTH * Map::AREA> m_children;
+	size_t	m_width{ MAX_WIDTH };
+	size_t	m_expanded{ 0 };
+};
 
-		vector<pair<Vec2, int>> boarderTiles;
-		boarderTiles.reserve(10); //to avoid allocations
+/* playouts of a few turns where both sides follow cheap random policies: units step to the best
+ * neighbor, a chain to the foe HQ wins when it's affordable, the rest of gold trains on the frontier.
+ * A board left by @S is worth the average difference of territory and income at the horizon */
+template <class S>
+class Rollouts {
+	using Foe = typename S::Foe;
+public:
+	template <class T>
+	using Grid = array<array<T, Map::WIDTH>, Map::HEIGHT>;
+	static const int MAX_TRAINS{ 8 }; // per turn of a side
+	static constexpr signed char NONE{ -1 };
+
+	struct Position {
+		Board	board; // seen by the side to play
+		Player	players[2]; // by owner
+		Grid<signed char> buildings; // owner * 3 + type or NONE, buildings on taken tiles are gone
+	};
 
-		queue<Vec2> Q;
-		Q.push(HQ);
+	struct Outcome {
+		double	value{ 0 }; // average, a taken HQ counts as ±mxScore
+		double	wins{ 0 }, losses{ 0 }; // shares of the playouts
+		int		playouts{ 0 };
+	};
 
-		while (!Q.empty()) {
-			auto top{ Q.front() };
-			Q.pop();
+	explicit Rollouts(uint32_t seed = 42) : m_rng(seed) {}
+	void Seed(uint32_t seed) noexcept { m_rng.seed(seed); }
 
-			for (auto& sh : m_shift) {
-				auto tile{ top + sh };
-				if (IsValid(tile) &&
-					!m_visited[tile.y][tile.x] &&
-					m_map->Get(tile) != Tile::blocked)
-				{
-					if (m_map->Get(tile) == type) {
-						m_visited[tile.y][tile.x] = true;
-						Q.push(tile);
-					}
-					else if(!m_added[top.y][top.x]) {
-						boarderTiles.emplace_back(top, 0);
-						m_added[top.y][top.x] = true;
-					}
-				}
+	// buildings and HQs of @data: boards are compared on the same map
+	void Setup(const Data& data) noexcept {
+		m_HQ[0] = data.m_bManager.HQ(0), m_HQ[1] = data.m_bManager.HQ(1);
+		for (auto& row : m_buildings) row.fill(NONE);
+		for (auto& b : data.m_bManager.m_buildings) {
+			m_buildings[b.m_pos.y][b.m_pos.x] = static_cast<signed char>(b.m_owner * 3 + toInt(b.m_type));
+		}
+	}
+	// for positions which carry their own buildings
+	void Setup(Vec2 HQ0, Vec2 HQ1) noexcept {
+		m_HQ[0] = HQ0, m_HQ[1] = HQ1;
+	}
+	// @board: seen by @S at the end of its turn, @foe plays the next one
+	Outcome Evaluate(const Board& board, const Player& me, const Player& foe, int horizon, int count) noexcept {
+		Outcome outcome;
+		for (int i = 0; i < count; i++) {
+			Position game{ board.Flipped(), {}, m_buildings };
+			game.players[S::owner] = me, game.players[Foe::owner] = foe;
+			int result{ 0 };
+			for (int turn = 0; turn < horizon && !result; turn++) {
+				if (this->Turn<Foe>(game)) result = -1;
+				game.board = game.board.Flipped();
+				if (!result && this->Turn<S>(game)) result = 1;
+				game.board = game.board.Flipped();
+			}
+			// the board is seen by the foe here
+			double value{ static_cast<double>(result * sd::mxScore) };
+			if (!result) {
+				value = this->Territory<S>(game) - this->Territory<Foe>(game) + 
+					this->Income<S>(game, false) - this->Income<Foe>(game, true);
 			}
+			outcome.value += value;
+			outcome.wins += result > 0;
+			outcome.losses += result < 0;
 		}
-
-		return boarderTiles;
+		outcome.playouts = count;
+		if (count) {
+			outcome.value /= count, outcome.wins /= count, outcome.losses /= count;
+		}
+		return outcome;
 	}
-	// Dijkstra: has error when we're removing towers! 
-	// protected tiles still calculated!
-	// ****
-	// Look for cheapest path to enemy HQ and it's cost
-	int Cost(Vec2 pos) {
-		int cost{ 0 };
-		bool isProtected{ m_bManager->IsProtected(pos,*m_map) };
-		auto unit{ m_uManager->GetUnitAt(pos) };
-		if (m_map->Get(pos) == Tile::mInactive) {
-			cost = 0;
+
+	// the whole turn of @X, the board is seen by @X: true if it took the foe HQ
+	template <class X>
+	bool Turn(Position& game) noexcept {
+		using XFoe = typename X::Foe;
+		auto& player{ game.players[X::owner] };
+		auto& board{ game.board };
+		player.m_income = this->Income<X>(game, true);
+		player.m_gold += player.m_income;
+		if (player.m_gold < 0) { // bankrupt: all units die
+			player.m_gold = 0;
+			for (auto& row : board.units)
+				for (auto& level : row) level = min(level, 0);
 		}
-		else if (isProtected) {
-			cost = sd::costByLevel[2];
+		// units step to the best neighbor, ties are broken randomly
+		Grid<bool> moved{};
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				int level{ board.units[y][x] };
+				if (level <= 0 || moved[y][x]) continue;
+				Vec2 from{ x, y }, best{ from };
+				int bestValue{ 0 };
+				for (auto& sh : m_shift) {
+					auto to{ from + sh };
+					if (!IsValid(to)) continue;
+					int needed{ this->Needed<X>(game, to) };
+					if (!needed || (needed > level && level < 3)) continue;
+					int value{ to == m_HQ[XFoe::owner] ? sd::mxScore : this->Value<X>(game, to) * 2 + static_cast<int>(m_rng() % 2) };
+					if (value > bestValue) bestValue = value, best = to;
+				}
+				if (best == from) continue;
+				board.units[y][x] = 0;
+				moved[best.y][best.x] = true;
+				if (this->Take<X>(game, best, level)) return true;
+			}
 		}
-		else if (unit.has_value()) {
-			cost = sd::costByLevel[min(unit->m_level + 1, 3) - 1];
+		// chain to the foe HQ
+		int chain{ board.template ChainCost<X>(m_HQ[XFoe::owner], [&](Vec2 p) { return this->IsProtected<X>(game, p); }) };
+		if (chain <= player.m_gold) return true;
+		// trainings on the frontier: the best of a few random tiles
+		StaticVector<Vec2, Map::AREA> frontier;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 p{ x, y };
+				if (board.tiles[y][x] == X::active || board.tiles[y][x] == Tile::blocked) continue;
+				if (any_of(m_shift.begin(), m_shift.end(), [&](Vec2 sh) { 
+					auto t{ p + sh };
+					return IsValid(t) && board.tiles[t.y][t.x] == X::active; 
+				})) frontier.push_back(p);
+			}
 		}
-		else {
-			cost = sd::costByLevel[0];
+		for (int train = 0; train < MAX_TRAINS && !frontier.empty(); train++) {
+			Vec2 best{ -1, -1 };
+			int bestValue{ -1 }, bestLevel{ 0 };
+			for (int sample = 0; sample < 3; sample++) {
+				auto p{ frontier[m_rng() % frontier.size()] };
+				int level{ this->Needed<X>(game, p) };
+				if (!level || board.tiles[p.y][p.x] == X::active || !player.CanCreateUnit(level, 1)) continue;
+				int value{ this->Value<X>(game, p) - level };
+				if (value > bestValue) bestValue = value, best = p, bestLevel = level;
+			}
+			if (bestLevel == 0) break;
+			player.CreateUnit(bestLevel, 1);
+			if (this->Take<X>(game, best, bestLevel)) return true;
 		}
-		return cost;
-	};
-	void FindPath(Vec2 start, Vec2 finish) {
-		this->ClearDijkstra();
-		 // calculate cost to conquire this tile
+		return false;
+	}
 
-		DijkstraPriority Q;
-		Q.emplace(start, start, 0);
-		m_cost[start.y][start.x] = 0;
-		while (!Q.empty()) {
-			auto top = Q.top();
-			Q.pop();
+private:
+	bool IsBuilding(const Position& game, Vec2 p, int owner, BType type) const noexcept {
+		return game.buildings[p.y][p.x] == owner * 3 + toInt(type);
+	}
+	template <class X>
+	int Territory(const Position& game) const noexcept {
+		int tiles{ 0 };
+		for (auto& row : game.board.tiles)
+			tiles += static_cast<int>(count(row.begin(), row.end(), X::active));
+		return tiles;
+	}
+	// active tiles and mines minus upkeep of @X, its units are positive when @seen
+	template <class X>
+	int Income(const Position& game, bool seen) const noexcept {
+		int income{ 0 };
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				int level{ seen ? game.board.units[y][x] : -game.board.units[y][x] };
+				if (level > 0) income -= sd::salaryByLevel[level - 1];
+				if (game.board.tiles[y][x] != X::active) continue;
+				income += 1;
+				if (this->IsBuilding(game, Vec2{ x, y }, X::owner, BType::Mine)) income += sd::incomeFromMine;
+			}
+		}
+		return income;
+	}
+	// covered by a tower of the foe of @X
+	template <class X>
+	bool IsProtected(const Position& game, Vec2 p) const noexcept {
+		using XFoe = typename X::Foe;
+		if (game.board.tiles[p.y][p.x] != XFoe::active) return false;
+		array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
+		return any_of(shift.begin(), shift.end(), [&](Vec2 sh) {
+			auto t{ sh + p };
+			return IsValid(t) && this->IsBuilding(game, t, XFoe::owner, BType::Tower) && game.board.tiles[t.y][t.x] == XFoe::active;
+		});
+	}
+	// level which @X needs to take @p, 0 if it can't be taken by @level
+	template <class X>
+	int Needed(const Position& game, Vec2 p) const noexcept {
+		using XFoe = typename X::Foe;
+		if (game.board.tiles[p.y][p.x] == Tile::blocked || game.board.units[p.y][p.x] > 0) return 0;
+		// own buildings can't be stood on
+		if (game.buildings[p.y][p.x] != NONE && game.buildings[p.y][p.x] / 3 == X::owner) return 0;
+		if (this->IsProtected<X>(game, p) || this->IsBuilding(game, p, XFoe::owner, BType::Tower)) return 3;
+		return min(max(-game.board.units[p.y][p.x], 0) + 1, 3);
+	}
+	// value of @p for @X: what the foe loses there
+	template <class X>
+	int Value(const Position& game, Vec2 p) const noexcept {
+		using XFoe = typename X::Foe;
+		auto type{ game.board.tiles[p.y][p.x] };
+		int value{ type == XFoe::active ? sd::activeTileScore : type == X::active ? 0 : sd::inactiveTileScore };
+		if (game.board.units[p.y][p.x] < 0) value += sd::costByLevel[-game.board.units[p.y][p.x] - 1];
+		return value;
+	}
+	// @X takes @p with a unit of @level, true if it was the foe HQ
+	template <class X>
+	bool Take(Position& game, Vec2 p, int level) noexcept {
+		using XFoe = typename X::Foe;
+		game.board.template Conquer<X>(p, level, m_HQ[XFoe::owner]);
+		if (game.buildings[p.y][p.x] != NONE && game.buildings[p.y][p.x] / 3 == XFoe::owner) game.buildings[p.y][p.x] = NONE;
+		return p == m_HQ[XFoe::owner];
+	}
 
-			if (m_visited[top.position.y][top.position.x]) continue;
+	const array<Vec2, 4> m_shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
+	mt19937	m_rng;
+	Vec2	m_HQ[2];
+	Grid<signed char> m_buildings;
+};
 
-			m_visited[top.position.y][top.position.x] = true;
-			m_parent[top.position.y][top.position.x] = top.parent;
+/* seeded contest-like positions: a point-symmetric map with the HQs in the corners and the position
+ * after some turns of self-play by the playout policies, which also build mines and towers */
+class StateGenerator {
+public:
+	using Rules = Rollouts<MySide>;
+	using Position = Rules::Position;
+	template <class T>
+	using Grid = Rules::Grid<T>;
 
-			if (top.position == finish) break;
+	static const int MINE_COST{ 20 }; // and 4 more for every mine owned
+	static const int TOWER_COST{ 15 };
+	static const int START_GOLD{ 10 };
 
-			for (auto shift : m_shift) {
-				Vec2 to{ shift + top.position };
-				Tile type{ m_map->Get(to) };
-				if (IsValid(to) && type != Tile::blocked && type != Tile::mActive ) {
-					int cost = Cost(to);
-					if (m_cost[to.y][to.x] > m_cost[top.position.y][top.position.x] + cost) {
-						m_cost[to.y][to.x] = m_cost[top.position.y][top.position.x] + cost;
-						Q.emplace(to, top.position, cost);
-					}
+	explicit StateGenerator(uint32_t seed) : m_rng(seed), m_rules(seed) {}
+
+	// a new map and the position after @turns of both sides, random if negative
+	void Generate(int turns) noexcept {
+		if (turns < 0) turns = 5 + static_cast<int>(m_rng() % 36);
+		this->Play(turns);
+	}
+	const Position& Current() const noexcept { return m_position; }
+	void Restore(const Position& position) noexcept { m_position = position; }
+	// one random change on the same map: a tile changes hands, gold of a player, a unit comes, moves or goes
+	void Mutate() noexcept {
+		auto& board{ m_position.board };
+		Vec2 p{ static_cast<int>(m_rng() % Map::WIDTH), static_cast<int>(m_rng() % Map::HEIGHT) };
+		switch (m_rng() % 4) {
+		case 0: {
+			const Tile kinds[]{ Tile::neutral, Tile::mActive, Tile::mInactive, Tile::eActive, Tile::eInactive };
+			if (board.tiles[p.y][p.x] != Tile::blocked) board.tiles[p.y][p.x] = kinds[m_rng() % 5];
+			break;
+		}
+		case 1:
+			m_position.players[m_rng() % 2].m_gold = static_cast<int>(m_rng() % 301);
+			break;
+		case 2: {
+			int owner{ static_cast<int>(m_rng() % 2) }, level{ 1 + static_cast<int>(m_rng() % 3) };
+			if (board.tiles[p.y][p.x] == Tile::blocked) break;
+			board.tiles[p.y][p.x] = owner == 0 ? MySide::active : EnemySide::active;
+			board.units[p.y][p.x] = owner == 0 ? level : -level;
+			break;
+		}
+		default: {
+			// the first unit from @p on
+			for (int i = 0; i < Map::AREA; i++) {
+				Vec2 from{ (p.x + i) % Map::WIDTH, (p.y + (p.x + i) / Map::WIDTH) % Map::HEIGHT };
+				int level{ board.units[from.y][from.x] };
+				if (!level) continue;
+				board.units[from.y][from.x] = 0;
+				auto to{ from + m_shift[m_rng() % 4] };
+				if (m_rng() % 2 && IsValid(to) && board.tiles[to.y][to.x] != Tile::blocked) {
+					board.tiles[to.y][to.x] = level > 0 ? MySide::active : EnemySide::active;
+					board.units[to.y][to.x] = level;
 				}
+				break;
 			}
-
 		}
+		}
+		this->Repair();
 	}
-
-	deque<pair<Vec2, int>> GetPath(Vec2 start, Vec2 finish) const {
-		/*
-			Point<size_t> step = finish;
-			while (step != start) {
-				m_path.push_front(step);
-				step = m_parents[step.y][step.x];
+	// the second half of the map mirrors the first one with the sides swapped
+	void Symmetrize() noexcept {
+		auto& board{ m_position.board };
+		auto& buildings{ m_position.buildings };
+		for (int i = 0; i < Map::AREA / 2; i++) {
+			Vec2 p{ i % Map::WIDTH, i / Map::WIDTH }, m{ Mirror(p) };
+			board.tiles[m.y][m.x] = Opposite(board.tiles[p.y][p.x]);
+			board.units[m.y][m.x] = -board.units[p.y][p.x];
+			auto b{ buildings[p.y][p.x] };
+			buildings[m.y][m.x] = b == Rules::NONE ? Rules::NONE : (1 - b / 3) * 3 + b % 3;
+		}
+		m_position.players[1] = m_position.players[0];
+	}
+	// units and buildings stand on tiles of their owners, HQs keep theirs
+	void Repair() noexcept {
+		auto& board{ m_position.board };
+		auto& buildings{ m_position.buildings };
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				auto b{ buildings[y][x] };
+				if (b == Rules::NONE) continue;
+				int owner{ b / 3 };
+				if (b % 3 == toInt(BType::HQ)) board.tiles[y][x] = owner == 0 ? MySide::active : EnemySide::active;
+				else if (SideOf(board.tiles[y][x]) != owner) buildings[y][x] = Rules::NONE;
+			}
+		}
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				int level{ board.units[y][x] };
+				if (!level) continue;
+				auto active{ level > 0 ? MySide::active : EnemySide::active };
+				if (board.tiles[y][x] != active || buildings[y][x] != Rules::NONE) board.units[y][x] = 0;
 			}
-			m_path.push_front(start);
-		*/
-		deque<pair<Vec2, int>> path;
-		Vec2 step = finish;
-		while (step != start) {
-			Vec2 parent{ m_parent[step.y][step.x] };
-			int cost{ m_cost[step.y][step.x] - m_cost[parent.y][parent.x] };
-			path.emplace_front( step, cost / 10 );
-			step = m_parent[step.y][step.x];
 		}
-		return path;
 	}
-
-	int GetCost(Vec2 finish) const noexcept {
-		return m_cost[finish.y][finish.x];
+	// input of the referee: mine spots, then the position seen by the player 0
+	void Print(ostream& out) const noexcept {
+		out << m_mines.size() << "\n";
+		for (auto& p : m_mines) out << p.x << " " << p.y << "\n";
+		this->PrintTurn(out);
 	}
-
-
-//private:
-	struct Data {
-		Vec2	position;	//tile position
-		Vec2 	parent;		//tile from which we had came
-		int		cost;	
-
-		Data() = default;
-		Data(Vec2 pos, Vec2 par, int c) :
-			position(pos), parent(par), cost(c) {}
-
-		friend bool operator <(const Data& t1, const Data&t2) {
-			return t1.cost < t2.cost;
+	void PrintTurn(ostream& out) const noexcept {
+		auto& board{ m_position.board };
+		for (auto& player : m_position.players) {
+			out << player.m_gold << "\n" << player.m_income << "\n";
 		}
-		friend bool operator >(const Data& t1, const Data&t2) {
-			return t1.cost > t2.cost;
+		for (auto& row : board.tiles) {
+			for (auto tile : row) out << toChar(tile);
+			out << "\n";
 		}
-	};
-
-	using DijkstraPriority = priority_queue<Data, vector<Data>, greater<Data>>;
-
-	void ClearDijkstra() {
-		for (int i = 0; i < Map::SIZE; i++) {
-			for (int j = 0; j < Map::SIZE; j++) {
-				m_visited[i][j] = false;
-				m_parent[i][j] = Vec2{-1,-1};
-				m_cost[i][j] = numeric_limits<int>::max();
+		StaticVector<Building, Map::AREA> buildings;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				auto b{ m_position.buildings[y][x] };
+				if (b != Rules::NONE) buildings.push_back(Building{ b / 3, static_cast<BType>(b % 3), Vec2{ x, y } });
+			}
+		}
+		// HQs first as the referee sends them
+		stable_partition(buildings.begin(), buildings.end(), [](const Building& b) { return b.IsHQ(); });
+		out << buildings.size() << "\n";
+		for (auto& b : buildings) out << b.m_owner << " " << toInt(b.m_type) << " " << b.m_pos.x << " " << b.m_pos.y << "\n";
+		int units{ 0 };
+		for (auto& row : board.units) units += static_cast<int>(count_if(row.begin(), row.end(), [](int level) { return level != 0; }));
+		out << units << "\n";
+		// ids by owner and tile: a unit which stays keeps its id over the turns, as the referee's do
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				int level{ board.units[y][x] }, owner{ level > 0 ? 0 : 1 };
+				if (level) out << owner << " " << owner * Map::AREA + y * Map::WIDTH + x + 1 << " " << abs(level) << " " << x << " " << y << "\n";
 			}
 		}
 	}
 
-	array<Vec2, 4> m_shift;
-	bool m_visited[Map::SIZE][Map::SIZE];
-	Vec2 m_parent[Map::SIZE][Map::SIZE];
-	int  m_cost[Map::SIZE][Map::SIZE];
+private:
+	static Vec2 Mirror(Vec2 p) noexcept { return { Map::WIDTH - 1 - p.x, Map::HEIGHT - 1 - p.y }; }
 
-	Map* m_map;
-	UnitManager* m_uManager;
-	BuildingManager* m_bManager;
+	void MakeMap() noexcept {
+		const Vec2 HQ[2]{ { 0, 0 }, { Map::WIDTH - 1, Map::HEIGHT - 1 } };
+		auto nearHQ = [&HQ](Vec2 p) { return p.Distanse(HQ[0]) <= 1 || p.Distanse(HQ[1]) <= 1; };
+		while (true) {
+			for (auto& row : m_blocked) row.fill(false);
+			int voids{ static_cast<int>(m_rng() % 16) };
+			for (int i = 0; i < voids; i++) {
+				Vec2 p{ static_cast<int>(m_rng() % Map::WIDTH), static_cast<int>(m_rng() % Map::HEIGHT) };
+				if (nearHQ(p)) continue;
+				m_blocked[p.y][p.x] = m_blocked[Mirror(p).y][Mirror(p).x] = true;
+			}
+			// islands are blocked too, the HQs must see each other
+			Grid<bool> reached{};
+			RingQueue<Vec2, Map::AREA> Q;
+			Q.push(HQ[0]);
+			reached[HQ[0].y][HQ[0].x] = true;
+			while (!Q.empty()) {
+				auto top{ Q.front() };
+				Q.pop();
+				for (auto& sh : m_shift) {
+					auto to{ top + sh };
+					if (!IsValid(to) || reached[to.y][to.x] || m_blocked[to.y][to.x]) continue;
+					reached[to.y][to.x] = true;
+					Q.push(to);
+				}
+			}
+			if (!reached[HQ[1].y][HQ[1].x]) continue;
+			for (int y = 0; y < Map::HEIGHT; y++)
+				for (int x = 0; x < Map::WIDTH; x++)
+					if (!reached[y][x]) m_blocked[y][x] = true;
+			break;
+		}
+		m_mines.clear();
+		int pairs{ 3 + static_cast<int>(m_rng() % 6) };
+		for (int tries = 0; tries < 100 && static_cast<int>(m_mines.size()) < 2 * pairs; tries++) {
+			Vec2 p{ static_cast<int>(m_rng() % Map::WIDTH), static_cast<int>(m_rng() % Map::HEIGHT) };
+			if (m_blocked[p.y][p.x] || nearHQ(p) || p == Mirror(p)) continue;
+			if (find(m_mines.begin(), m_mines.end(), p) != m_mines.end()) continue;
+			m_mines.push_back(p);
+			m_mines.push_back(Mirror(p));
+		}
+		sort(m_mines.begin(), m_mines.end());
+	}
+	// stops before the turn which takes an HQ: the game would be over
+	void Play(int turns) noexcept {
+		this->MakeMap();
+		const Vec2 HQ[2]{ { 0, 0 }, { Map::WIDTH - 1, Map::HEIGHT - 1 } };
+		m_rules.Setup(HQ[0], HQ[1]);
+		auto& board{ m_position.board };
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			board.tiles[y].fill(Tile::neutral);
+			board.units[y].fill(0);
+			m_position.buildings[y].fill(Rules::NONE);
+			for (int x = 0; x < Map::WIDTH; x++)
+				if (m_blocked[y][x]) board.tiles[y][x] = Tile::blocked;
+		}
+		for (int owner = 0; owner < 2; owner++) {
+			board.tiles[HQ[owner].y][HQ[owner].x] = owner == 0 ? MySide::active : EnemySide::active;
+			m_position.buildings[HQ[owner].y][HQ[owner].x] = static_cast<signed char>(owner * 3 + toInt(BType::HQ));
+			m_position.players[owner] = Player{ START_GOLD, 0, 0 };
+		}
+		for (int turn = 0; turn < turns; turn++) {
+			m_saved = m_position;
+			bool over{ m_rules.Turn<MySide>(m_position) };
+			this->Build<MySide>();
+			board = board.Flipped();
+			over = over || m_rules.Turn<EnemySide>(m_position);
+			this->Build<EnemySide>();
+			board = board.Flipped();
+			if (over) {
+				m_position = m_saved;
+				return;
+			}
+		}
+	}
+	// a mine on a random spot and sometimes a tower on the border, the board is seen by @X
+	template <class X>
+	void Build() noexcept {
+		auto& player{ m_position.players[X::owner] };
+		auto& board{ m_position.board };
+		auto& buildings{ m_position.buildings };
+		auto isFree = [&](Vec2 p) {
+			return board.tiles[p.y][p.x] == X::active && !board.units[p.y][p.x] && buildings[p.y][p.x] == Rules::NONE;
+		};
+		int owned{ 0 };
+		for (auto& row : buildings)
+			owned += static_cast<int>(count(row.begin(), row.end(), X::owner * 3 + toInt(BType::Mine)));
+		int cost{ MINE_COST + 4 * owned };
+		if (player.m_gold >= cost && m_rng() % 2) {
+			auto spot{ m_mines[m_rng() % m_mines.size()] };
+			if (isFree(spot)) {
+				buildings[spot.y][spot.x] = static_cast<signed char>(X::owner * 3 + toInt(BType::Mine));
+				player.m_gold -= cost;
+			}
+		}
+		if (player.m_gold >= TOWER_COST && m_rng() % 4 == 0) {
+			Vec2 p{ static_cast<int>(m_rng() % Map::WIDTH), static_cast<int>(m_rng() % Map::HEIGHT) };
+			bool border{ any_of(m_shift.begin(), m_shift.end(), [&](Vec2 sh) {
+				auto t{ p + sh };
+				return IsValid(t) && board.tiles[t.y][t.x] != X::active && board.tiles[t.y][t.x] != Tile::blocked;
+			}) };
+			if (border && isFree(p) && find(m_mines.begin(), m_mines.end(), p) == m_mines.end()) {
+				buildings[p.y][p.x] = static_cast<signed char>(X::owner * 3 + toInt(BType::Tower));
+				player.m_gold -= TOWER_COST;
+			}
+		}
+	}
+	const array<Vec2, 4> m_shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
+	mt19937		m_rng;
+	Rules		m_rules;
+	Grid<bool>	m_blocked;
+	StaticVector<Vec2, Map::AREA> m_mines;
+	Position	m_position, m_saved;
 };
 
+/* plans the turn of @S: the game plays MySide, the foe's side is only instantiated below */
+template <class S>
 class Commander {
+	using Foe = typename S::Foe;
 public:	
-	Commander(Data *data) :
+	Commander(Data *data, const StaticMap* tables) :
 		m_data(data),
+		m_static(tables),
+		m_rng(random_device{}()),
 		m_search(&data->m_map,&data->m_uManager, &data->m_bManager),
-		m_bridges(&data->m_map)
+		m_analysis(data, tables)
 	{
 	}
 
-	void UpdateEnemyBridge() {
-		m_eBridges = m_bridges.GetBridges(Tile::eActive);
-		m_eBridges.shrink_to_fit();
-	}
-	void UpdateMyBridge() {
-		m_mBridges = m_bridges.GetBridges(Tile::mActive);
-		m_mBridges.shrink_to_fit();
-	}
-
-	void UpdateBridges() {
-		UpdateEnemyBridge();
-		UpdateMyBridge();
-	}
-
 	void Update() {
-		m_mHQ = Vec2{ 0,0 }, m_eHQ = Vec2{ 11,11 };
-		if (m_data->m_map.Get(Vec2{ 0,0 }) == Tile::eActive)
-			swap(m_mHQ, m_eHQ);
+		m_mHQ = S::HQ(*m_data), m_eHQ = Foe::HQ(*m_data);
 
 		assert(m_eBridges.empty());
 		assert(m_mBridges.empty());
 
-		this->UpdateBridges();
+		m_analysis.Reset(m_pondered, m_data->m_delta.IsLarge());
+		m_analysis.UpdateBridges();
+		m_mBridges = m_analysis.Bridges(S::active);
+		m_eBridges = m_analysis.Bridges(Foe::active);
+	}
+	TurnAnalysis& Analysis() noexcept { return m_analysis; }
+	// randomness of the turn: a captured turn replays with the same seed
+	void Seed(uint32_t seed) noexcept {
+		m_rng.seed(seed);
+		m_rollouts.Seed(seed);
+	}
+	// time the answer must be printed by
+	void SetDeadline(chrono::steady_clock::time_point deadline) noexcept {
+		m_deadline = deadline;
+	}
+	// analyses precomputed while the enemy played; nullptr if there are none
+	void SetPondered(const PonderResult* pondered) noexcept {
+		m_pondered = pondered;
 	}
 
 	void Clear() noexcept {
 		m_takenPositions.clear();
+		m_moved.clear();
 		m_answer.clear();
 		m_mBridges.clear();
 		m_eBridges.clear();
 		m_search.Clear();
+		m_pondered = nullptr;
 	}
-	// invalid pair {-1,-1}
-	pair<int, int> MinMaxLevelAround(Vec2 p, Tile type) const noexcept {
-		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
-		auto& map{ m_data->m_map };
-		int mn = 1000, mx = -1;
-		for (auto& sh : shift) {
-			auto neighbor{ sh + p };
-			if (IsValid(neighbor) && map.Get(neighbor) == type) {
-				auto optUnit = m_data->m_uManager.GetUnitAt(neighbor);
-				if (optUnit.has_value()) {
-					mn = min (optUnit.value().m_level, mn);
-					mx = max (optUnit.value().m_level, mx);
-				}
-			}
-		}
-		if (mn == 1000 && mx == -1) { mn = -1, mx = -1; }
-		return { mn, mx };
-	}
-	bool CanCreateUnit(bool isMe, int level, int expectedIncome ) const noexcept {
-		auto& player = isMe ? m_data->m_me : m_data->m_enemy;
-		return player.CanCreateUnit(level, expectedIncome);
-	}
-	// O (5 * (size(buildings) + size(units)) ): max possible: 144*5 =   720
-	optional<Vec2> GetPositionForTowerAround(Vec2 p) const noexcept{
-		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+	// empty tiles where a tower protects @p: @p itself and my active neighbors
+	StaticVector<Vec2, 5> TowerSpotsAround(Vec2 p) {
+		array<Vec2, 5> shift{ Vec2{0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
 		auto& map{ m_data->m_map };
 		auto& uManager{ m_data->m_uManager };
-		auto NoEnemyLevelThree = [&uManager](Vec2 v) {
-			auto opt{ uManager.GetUnitAt(v) };
-			return !(opt.has_value() && opt->m_level == 3 && !opt->IsMy());
-
-		};
+		auto& bManager{ m_data->m_bManager };
+		StaticVector<Vec2, 5> spots;
 		for (auto& sh : shift) {
-			auto neighbor{ sh + p };
-			if (IsValid(neighbor)
-				&& map.Get(neighbor) == Tile::mInactive 
-				&& !m_data->m_bManager.GetBuildingAt(neighbor).has_value()
-				&& !uManager.GetUnitAt(neighbor).has_value()
-			) {
-				bool isSafe{ this->AllNeighbors<decltype(NoEnemyLevelThree)>(neighbor, NoEnemyLevelThree).empty() };
-
-				// if there aren't any enemy units level 3 around!
-				if(isSafe)
-					return make_optional(neighbor);
-			}
-		}
-		if (!m_data->m_bManager.GetBuildingAt(p).has_value()
-			&& !m_data->m_uManager.GetUnitAt(p).has_value())
-		{ // it's already checked for @p that htere is no level 3 enemy unit around!
-			return make_optional(p);
+			auto spot{ sh + p };
+			if (!IsValid(spot) || map.Get(spot) != S::active) continue;
+			if (bManager.GetBuildingAt(spot).has_value() || bManager.IsMineSpot(spot)) continue;
+			if (uManager.GetUnitAt(spot).has_value()) continue;
+			// enemy unit of level 3 destroys it
+			if (m_analysis.FoeLevelsAround<S>(spot).second == 3) continue;
+			spots.push_back(spot);
 		}
-		return nullopt;
+		return spots;
 	}
-	optional<Vec2> GetInactiveNeighbor(bool isMy, Vec2 p) const noexcept {
+	template <class Who>
+	optional<Vec2> GetInactiveNeighbor(Vec2 p) const noexcept {
 		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
 		auto& map{ m_data->m_map };
 		for (auto& sh : shift) {
 			auto neighbor{ sh + p };
-			if (IsValid(neighbor) && map.Get(neighbor) == (isMy? Tile::mInactive: Tile::eInactive)) {
+			if (IsValid(neighbor) && map.Get(neighbor) == Who::inactive) {
 				return make_optional(neighbor);
 			}
 		}
@@ -943,14 +4030,14 @@ public:
 		auto& map{ m_data->m_map };
 		for (auto& sh : shift) {
 			auto neighbor{ sh + p };
-			if (IsValid(neighbor) && map.Get(neighbor) == Tile::eActive ) {
+			if (IsValid(neighbor) && map.Get(neighbor) == Foe::active ) {
 				return true;
 			}
 		}
 		return false;
 	}
 	bool IsBridge(Vec2 p, Tile type) const noexcept {
-		auto& bridges{ ( type == Tile::eActive ? m_eBridges : m_mBridges) };
+		auto& bridges{ ( type == Foe::active ? m_eBridges : m_mBridges) };
 		return (find_if(bridges.begin(), bridges.end(), [&p](auto edge) {
 				return p == edge.second || p == edge.first;
 		}) != bridges.end());
@@ -962,32 +4049,6 @@ public:
 			return (b.IsTower() && p == b.m_pos);
 		}) != buildings.end());
 	}
-	bool IsProtected(Vec2 p) const noexcept {
-		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
-
-		auto& map{ m_data->m_map };
-		Tile ty{ map.Get(p) };
-		auto& buildings{ m_data->m_bManager.m_buildings };
-
-		if (find_if(buildings.begin(), buildings.end(), [&p,&shift,&map, &ty](auto& b) {
-			if (b.IsTower() && ty == map.Get(b.m_pos)) {
-				if (b.m_pos == p) return true;
-
-				for (auto& sh : shift) {
-					auto towerNeighbor { sh + b.m_pos };
-					if (towerNeighbor == p)
-					{ // tower and neighbor has the same owner
-						return true;
-					}
-				}
-			}
-			return false;
-		}) != buildings.end())
-		{
-			return true;
-		}
-		return false;
-	}
 	bool IsMineSpot(Vec2 p) const noexcept {
 		const auto& spots{ m_data->m_bManager.m_mines };
 		return (find_if(spots.cbegin(), spots.cend(), [&p](const auto& spot) {
@@ -1001,11 +4062,10 @@ public:
 		}) != buildings.cend());
 	}
 	template <class Pred>
-	vector<Vec2> AllNeighbors(Vec2 center, Pred pred) const noexcept {
+	Neighbors AllNeighbors(Vec2 center, Pred pred) const noexcept {
 		static_assert(is_invocable_v<Pred, Vec2>, "Can't invoce predicate");
 		array<Vec2, 4> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1} };
-		vector<Vec2> neighbors;
-		neighbors.reserve(4);
+		Neighbors neighbors;
 		auto& map{ m_data->m_map };
 		for (auto& sh : shift) {
 			auto neighbor{ sh + center };
@@ -1015,24 +4075,27 @@ public:
 		}
 		return neighbors;
 	}
-	vector<Vec2> GetMyMineSpots() const noexcept {
-		vector<Vec2> spots;
+	StaticVector<Vec2, Map::AREA> GetMyMineSpots() const noexcept {
+		StaticVector<Vec2, Map::AREA> spots;
 		auto& mines{ m_data->m_bManager.m_mines };
 		auto& map{ m_data->m_map };
 		for_each(mines.begin(), mines.end(), [&spots,&map](auto&mine) {
-			if (map.Get(mine.m_pos) == Tile::mActive)
+			if (map.Get(mine.m_pos) == S::active)
 				spots.emplace_back(mine.m_pos);
 		});
 		return spots;
 	}
 
-	bool CanChainFrom(Vec2 from, Vec2 to, Tile chainnerType) {
+	// the foe plays next: it will have its income too
+	template <class Chainer>
+	bool CanChainFrom(Vec2 from, Vec2 to) {
 		int cost{ m_search.GetCost(to) };
-		if( chainnerType == Tile::eActive ) {
-			return cost <= m_data->m_enemy.m_gold + m_data->m_enemy.m_income;
+		auto& player{ Chainer::Self(*m_data) };
+		if constexpr (is_same_v<Chainer, Foe>) {
+			return cost <= player.m_gold + player.m_income;
 		}
 		else {
-			return cost <= m_data->m_me.m_gold;
+			return cost <= player.m_gold;
 		}
 	}
 	int ScoreMove(Vec2 dest, const Unit& unit) noexcept {
@@ -1040,38 +4103,20 @@ public:
 		auto& map{ m_data->m_map };
 		auto& uManager{ m_data->m_uManager };
 		auto& bManager{ m_data->m_bManager };
-		auto& buildings{ bManager.m_buildings };
-		auto& enemy{ m_data->m_enemy };
+		auto& enemy{ Foe::Self(*m_data) };
 
 		// calculations that used often
 		bool hasActiveEnemyNeighbor{ this->HasActiveEnemyNeighbor(dest) };
-		auto myInactiveNeighbor{ this->GetInactiveNeighbor(true, dest) };
-		auto[eMinLevel, eMaxLevel] = this->MinMaxLevelAround(dest, Tile::eActive);
+		auto myInactiveNeighbor{ this->template GetInactiveNeighbor<S>(dest) };
+		auto[eMinLevel, eMaxLevel] = m_analysis.FoeLevelsAround<S>(dest);
 		auto worth{ sd::costByLevel[unit.m_level - 1] };
 		auto AddMyInactiveComponent = [&](int& score) {
 			// @pos is always valid
-			auto pred = [&map](Vec2 pos) {
-				return map.Get(pos) == Tile::mInactive;
-			};
-			auto calc = [&buildings, &bManager](Vec2 pos)
-			{ // need a sum: visit number and buildings cost!
-				auto it = find_if(buildings.begin(), buildings.end(), [&pos](auto&b) {
-					return b.m_pos == pos;
-				});
-				int score{ 0 };
-				if (it == buildings.end()) {
-					score = sd::inactiveTileScore;
-				}
-				else if (it->m_type == BType::Tower) {
-					score = sd::towerCost + sd::inactiveTileScore;
-				}
-				else if (it->m_type == BType::Mine) {
-					score = sd::minMineCost + 4 * bManager.Count(BType::Mine, false) + sd::inactiveTileScore;
-				}
-				return score;
-			};
-			m_search.Clear();
-			m_search.Dfs<decltype(pred), decltype(calc)>(myInactiveNeighbor.value(), score, pred, calc);
+			auto component{ m_analysis.InactiveComponent<S>(myInactiveNeighbor.value()) };
+			// need a sum: visit number and buildings cost!
+			score += component->tiles * sd::inactiveTileScore
+				+ component->towers * sd::towerCost
+				+ component->mines * (sd::minMineCost + 4 * (int)bManager.Count(BType::Mine, Foe::owner));
 			cerr << "Find |CC| with size of " << score << " at " << dest << endl;
 		};
 
@@ -1091,20 +4136,20 @@ public:
 		}; break;
 		case Tile::neutral: {
 			score = sd::defaultScore;
-			if (hasActiveEnemyNeighbor && this->CanCreateUnit(false, 3, 1) && unit.m_level == 3)
+			if (hasActiveEnemyNeighbor && enemy.CanCreateUnit(3, 1) && unit.m_level == 3)
 			{ // otherwise all units are cheap and I don't care about low level one
 				cerr << "Can't risk level 3 unit!" << endl;
 				score = mn;
 			}
 		}; break;
-		case Tile::mActive: {
+		case S::active: {
 			bool isEmpty{ true };
 			isEmpty &= !uManager.GetUnitAt(dest).has_value();
 			if(isEmpty) isEmpty &= !bManager.GetBuildingAt(dest).has_value();
 			if (unit.m_pos == dest || isEmpty) {
-				bool isBridge{ this->IsBridge(dest, Tile::mActive) };
+				bool isBridge{ this->IsBridge(dest, S::active) };
 				if (hasActiveEnemyNeighbor && isBridge) {
-					bool isDangerous{ this->CanCreateUnit(false, min(unit.m_level + 1, 3), 1) };
+					bool isDangerous{ enemy.CanCreateUnit(min(unit.m_level + 1, 3), 1) };
 					if (isDangerous || eMaxLevel > unit.m_level || eMaxLevel == 3) {
 						score = mn;
 						if (unit.m_pos == dest) 
@@ -1113,30 +4158,27 @@ public:
 					}
 					else { 
 						// CC ( units +  buildings + visits) which can be lost with destroyed bridge!
-						m_search.Clear();
-						score = m_search.GetScoreAfterBridge(m_mHQ, dest, Tile::mActive);
+						score = m_analysis.CutValue(dest, S::active);
 						if (unit.m_pos == dest) score -= sd::costByLevel[unit.m_level - 1]; // don't include unit
 						cerr << "Trying to save |CC| with size of " << score << " at " << dest << endl;
 					}
 				}
 			}
 		}; break;
-		case Tile::mInactive: {
+		case S::inactive: {
 			cerr << "Error! Trying to create on my inactive tile : " << dest << endl;
 		}; break;
-		case Tile::eActive: {
-			bool isBridge{ this->IsBridge(dest, Tile::eActive) };
+		case Foe::active: {
+			bool isBridge{ this->IsBridge(dest, Foe::active) };
 			//cerr << dest << " is bridge: " << boolalpha << isBridge << endl;
 			auto optUnit{ uManager.GetUnitAt(dest) };
 			auto optBuilding{ bManager.GetBuildingAt(dest) };
 			auto addForBridge = [&]() {
-				auto deal{ 0 };
 				// CC ( units +  buildings + visits) which can be lost with destroyed bridge!
-				m_search.Clear();
-				deal = m_search.GetScoreAfterBridge(m_eHQ, dest, Tile::eActive);
+				auto deal{ m_analysis.CutValue(dest, Foe::active) };
 				score += deal;
 			};
-			if (this->IsProtected(dest)) // O(buildings.size() * shift.size())
+			if (m_analysis.IsProtected(dest)) // O(buildings.size() * shift.size())
 			{ // only unit level 3 can advance
 				if (unit.m_level == 3) {
 					if (myInactiveNeighbor.has_value()) {
@@ -1247,7 +4289,7 @@ public:
 			}
 		}; break;
 		//used when map hasn't updated yet (not it should by hand but not sre it works good)
-		case Tile::eInactive: {
+		case Foe::inactive: {
 			score = sd::inactiveTileScore;
 			if(myInactiveNeighbor.has_value())
 			{ // calculate CC size:
@@ -1276,26 +4318,24 @@ public:
 		auto& bManager{ m_data->m_bManager };
 		auto& units{ uManager.m_units };
 
-		std::random_device rd;
-		std::mt19937 g(rd());
-		shuffle(units.begin(), units.end(),g);
+		shuffle(units.begin(), units.end(), m_rng);
+		m_flowSearches = 0;
 
 		cerr << "All units: " << endl;
 		for_each(units.begin(), units.end(), [](auto&u) {cerr << u.m_id <<" "<<u.m_pos <<"; "; });
 		cerr << endl;
 
 		for (auto& unit : units) {
-			if (unit.IsMy()) {
-				vector<pair<Vec2, int>> targets;
-				targets.reserve(5); // max possible number of neighbors + occupied tile
+			if (S::Owns(unit.m_owner)) {
+				StaticVector<pair<Vec2, int>, 5> targets; // max possible number of neighbors + occupied tile
 				for (auto& sh : shift) {
 					auto neighbor{ unit.m_pos + sh };
 					
 					if (!IsValid(neighbor)) continue;
 					auto occupant { uManager.GetUnitAt(neighbor) };
 					auto building{ bManager.GetBuildingAt(neighbor) };
-					bool isOccupiedByEnemy{ occupant.has_value() && !occupant->IsMy()};
-					auto isOccupiedByMyBuilding{ building.has_value() && building->IsMy() };
+					bool isOccupiedByEnemy{ occupant.has_value() && !S::Owns(occupant->m_owner)};
+					auto isOccupiedByMyBuilding{ building.has_value() && S::Owns(building->m_owner) };
 
 					if ( map.Get(neighbor) != Tile::blocked && //not blocked
 						(!occupant.has_value() || isOccupiedByEnemy) && //nobody or enemy
@@ -1316,137 +4356,258 @@ public:
 				});
 				cerr << endl;
 				
+				this->UpdateFlow();
 				auto bestTarget = max_element(targets.begin(), targets.end(), [this](auto& l, auto& r) {
 					if (l.second == r.second) {
-						return l.first.Distanse(m_eHQ) > r.first.Distanse(m_eHQ);
+						return this->FlowOrder(l.first) > this->FlowOrder(r.first);
 					}
 					return l.second < r.second;
 				});
 
 				if (!(bestTarget->first == unit.m_pos)) {
 					m_answer.emplace_back(commands::Move(unit.m_id, bestTarget->first));
-					if (this->IsBridge(bestTarget->first, Tile::eActive)) 
+					m_moved.push_back(unit.m_id);
+					if (this->IsBridge(bestTarget->first, Foe::active)) 
 					{ // cut of connected component
 						m_search.Clear();
-						m_search.ChangeTilesAfterTheBridge(m_eHQ, bestTarget->first, Tile::eActive, Tile::eInactive);
+						m_search.ChangeTilesAfterTheBridge(m_eHQ, bestTarget->first, Foe::active, Foe::inactive);
 					}
 					//CAN BE ERROR IF INVALID TRAINING (THERE IS UNIT WITH LEVEL > MY LEVEL)
 					// i.g. all scores are -1000, will it  choose the tile close to headquaters?? 
-					map.m_map[bestTarget->first.y][bestTarget->first.x] = Tile::mActive;
+					map.Set(bestTarget->first, S::active);
 					//m_takenPositions.insert(bestTarget->first);
-					unit.m_pos = bestTarget->first; // update position
+					uManager.MoveUnit(unit, bestTarget->first); // update position
 				}
 			}
 		}
+		cerr << "Flow fields were searched " << m_flowSearches << " times" << endl;
+	}
+
+	// blocking pattern: my units and buildings, enemy tiles covered by towers
+	void UpdateFlow() {
+		auto& map{ m_data->m_map };
+		auto& bManager{ m_data->m_bManager };
+		FlowField::Mask blocked{}, enemyHQ{}, mines{}, frontier{};
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 p{ x, y };
+				Tile ty{ map.Get(p) };
+				blocked[y][x] = ty == Tile::blocked || (SideOf(ty) == Foe::owner && m_analysis.IsProtected(p));
+			}
+		}
+		for (auto& unit : m_data->m_uManager.m_units) {
+			if (S::Owns(unit.m_owner)) blocked[unit.m_pos.y][unit.m_pos.x] = true;
+		}
+		for (auto& building : bManager.m_buildings) {
+			if (S::Owns(building.m_owner)) blocked[building.m_pos.y][building.m_pos.x] = true;
+		}
+		enemyHQ[m_eHQ.y][m_eHQ.x] = true;
+		for (auto& mine : bManager.m_mines) {
+			if (map.Get(mine.m_pos) != S::active) mines[mine.m_pos.y][mine.m_pos.x] = true;
+		}
+		for (auto[tile, score] : m_analysis.Frontier<S>()) {
+			frontier[tile.y][tile.x] = true;
+		}
+		m_flowSearches += m_toEnemyHQ.Update(blocked, enemyHQ);
+		m_flowSearches += m_toMines.Update(blocked, mines);
+		m_flowSearches += m_toFrontier.Update(blocked, frontier);
+	}
+	// less is better: enemy HQ, then uncaptured mine spots, then the frontier
+	tuple<int, int, int> FlowOrder(Vec2 p) const noexcept {
+		return { m_toEnemyHQ.StepsFrom(p), m_toMines.StepsFrom(p), m_toFrontier.StepsFrom(p) };
 	}
 
 	void DefendFromChainAttack() {
-		auto& uManager{ m_data->m_uManager };
 		auto& bManager{ m_data->m_bManager };
-		auto& me{ m_data->m_me };
+		auto& me{ S::Self(*m_data) };
+		auto& enemy{ Foe::Self(*m_data) };
+
+		int budget{ enemy.m_gold + enemy.m_income };
+		auto threat{ m_analysis.EnginesOf(0).m_threat.Evaluate<S>(budget, me.m_gold) };
+		if (threat.cost < 0) return;
+
+		cerr << "Enemy can chain to HQ for " << threat.cost << " of " << budget << " from " << threat.path.front() << endl;
+		int cost{ sd::towerCost * (int)threat.towers.size() };
+		// a partial defence doesn't stop the chain
+		if (threat.towers.empty() || !me.CanCreateBuilding(cost)) return;
+		for (Vec2 tower : threat.towers) {
+			me.CreateBuilding(sd::towerCost, 0);
+			m_answer.emplace_back(commands::Build(BType::Tower, tower));
+			// UPDATE BUILDINGS
+			bManager.AddBuilding(S::owner, BType::Tower, tower);
+			cerr << "Defend from chain by tower at: " << tower << endl;
+		}
+	}
+	bool HasMoved(int id) const noexcept {
+		return find(m_moved.begin(), m_moved.end(), id) != m_moved.end();
+	}
+	// my active tiles only start chains, the tree is repaired where conquest costs changed
+	void UpdateChainTree() {
 		auto& map{ m_data->m_map };
-
-	//	for()
+		ChainTree::Costs costs;
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 p{ x, y };
+				Tile ty{ map.Get(p) };
+				costs[y][x] = ty == Tile::blocked || ty == S::active ? ChainTree::INF : m_search.Cost<S>(p);
+			}
+		}
+		if (!m_chainTree.IsBuilt(m_eHQ)) {
+			m_chainTree.Build(m_eHQ, costs);
+			return;
+		}
+		int repaired{ m_chainTree.Update(costs) };
+		cerr << "Chain tree is repaired from " << repaired << " tiles" << endl;
 	}
-	void TryChainAttack() {
-		auto tiles{ m_search.GetOutline(Tile::mActive) };
+	// true if a chain to the foe's HQ is trained: the game is won, nothing else matters
+	bool TryChainAttack() {
+		auto tiles{ m_analysis.Outline<S>() };
 		cerr << "Outline: ";
 		for (auto tile : tiles) {
 			cerr << tile.first << " ";
 		}
 		cerr << endl;
+		// chains from every outline tile are bounded by one tree
+		this->UpdateChainTree();
+		auto& uManager{ m_data->m_uManager };
 		for (auto tile : tiles) {
-			m_search.FindPath(tile.first, m_eHQ);
-			int cost{ m_search.GetCost(m_eHQ) };
-			bool canChain{ cost <= m_data->m_me.m_gold };
-			cerr << "\tCost from " << tile.first << " to " << m_eHQ << " is " << cost << " ? " << m_data->m_me.m_gold << endl;
-			if (canChain)
-			{
-				auto path{ m_search.GetPath(tile.first, m_eHQ) };
-				path.shrink_to_fit();
-				for (auto [step, level] : path) {
-					if (level == 0) continue; //mInactive
-					m_data->m_me.CreateUnit(level, 0);
-					m_answer.emplace_back(commands::Train(level, step));
+			int cost{ m_chainTree.Distance(tile.first) };
+			cerr << "\tCost from " << tile.first << " to " << m_eHQ << " is " << cost << " ? " << S::Self(*m_data).m_gold << endl;
+			if (cost > S::Self(*m_data).m_gold) continue;
+			// gold, upkeep and my unit on the tile decide if the chain is real
+			auto walker{ uManager.GetUnitAt(tile.first) };
+			if (walker && (!S::Owns(walker->m_owner) || walker->m_id < 0 || this->HasMoved(walker->m_id))) walker.reset();
+			auto plan{ m_planner.Find(tile.first, S::Self(*m_data), walker, m_chainTree) };
+			if (plan.cost < 0) continue;
+
+			cerr << "\tChain to " << m_eHQ << " for " << plan.cost << (plan.walks ? " with a walker" : "") << endl;
+			auto& map{ m_data->m_map };
+			for (size_t i = 0; i < plan.path.size(); i++) {
+				auto [step, level] { plan.path[i] };
+				if (i == 0 && plan.walks) {
+					m_answer.emplace_back(commands::Move(walker->m_id, step));
+					m_moved.push_back(walker->m_id);
+					auto unit{ find_if(uManager.m_units.begin(), uManager.m_units.end(), [&](const Unit& u) { return u.m_id == walker->m_id; }) };
+					uManager.MarkUnitForRemove(step);
+					uManager.MoveUnit(*unit, step);
+					map.Set(step, S::active);
+					continue;
 				}
-				break;
+				if (level == 0) continue; //mInactive
+				uManager.MarkUnitForRemove(step);
+				S::Self(*m_data).CreateUnit(level, 1);
+				m_answer.emplace_back(commands::Train(level, step));
+				// UPDATE UNITS
+				uManager.AddUnit(S::owner, -1, level, step); // -1 is undef id
+				map.Set(step, S::active);
 			}
+			uManager.RemoveMarkedUnits();
+			return true;
 		}
 // maybe only tiles with enemy tile near?
 		auto& map{ m_data->m_map };
 		// try to attack enemy connections!
-		int gold { m_data->m_me.m_gold };
-		Tile saved[Map::SIZE][Map::SIZE];
-
-		deque<pair<Vec2, int>> bestPath;
-		int bestDiff = { 0 };
+		int gold { S::Self(*m_data).m_gold };
 
-		for (auto [tile,score] : tiles) {
-			m_search.FindPath(tile, Vec2{-1,-1});
-			for (int x = 0; x < Map::SIZE; x++) {
-				for (int y = 0; y < Map::SIZE; y++)
+		// best cut for every outline tile: what-if runs on worker's copy of the map
+		struct Cut {
+			int		diff{ 0 };
+			Vec2	target{ -1, -1 };
+		};
+		StaticVector<Cut, Map::AREA> cuts;
+		cuts.resize(tiles.size());
+		auto& table{ m_analysis.Table() };
+		auto cutTask = [&](size_t i, size_t worker) {
+			auto& engines{ m_analysis.EnginesOf(worker) };
+			auto& search{ engines.m_search };
+			auto& copy{ engines.m_map };
+			Vec2 tile{ tiles[i].first };
+			Tile saved[Map::HEIGHT][Map::WIDTH];
+
+			// size of the enemy's component of HQ depends on tiles only
+			auto component = [&]() {
+				auto key{ copy.m_hash ^ zobrist::OfQuery(m_eHQ, zobrist::COMPONENT, Foe::owner) };
+				if (auto size{ table.Find(key) }) return *size;
+				int size{ 0 };
+				search.Clear(); // clear only visited array
+				search.Dfs(m_eHQ, size, Foe::active);
+				table.Store(key, size);
+				return size;
+			};
+			search.FindPath<S>(tile, Vec2{ -1,-1 });
+			// before: the same for every path
+			int before{ component() };
+			for (int x = 0; x < Map::WIDTH; x++) {
+				for (int y = 0; y < Map::HEIGHT; y++)
 				{
-					int cost{ m_search.GetCost(Vec2{x,y}) };
+					int cost{ search.GetCost(Vec2{x,y}) };
 					if (cost <= gold && cost > 0) 
 					{ // reachable
-						auto path = m_search.GetPath(tile, Vec2{ x,y });
-
-						// before:
-						int before{ 0 };
-						m_search.Clear(); // clear only visited array
-						m_search.Dfs(m_eHQ, before, Tile::eActive);
+						auto path = search.GetPath(tile, Vec2{ x,y });
 						for (auto[pos, level] : path) {
-							saved[pos.y][pos.x] = map.m_map[pos.y][pos.x];
-							map.m_map[pos.y][pos.x] = Tile::mActive;
+							saved[pos.y][pos.x] = copy.Get(pos);
+							copy.Set(pos, S::active);
 						}
-						int after{ 0 };
-						m_search.Clear(); // clear only visited array
-						m_search.Dfs(m_eHQ, after, Tile::eActive);
+						int after{ component() };
 						// restore path
 						for (auto[pos, level] : path) {
-							map.m_map[pos.y][pos.x] = saved[pos.y][pos.x];
+							copy.Set(pos, saved[pos.y][pos.x]);
 						}
 
 						int diff{ before - after };
-						if (diff > bestDiff) {
-							bestDiff = diff;
-							bestPath.clear();
-							bestPath = move(path);
+						if (diff > cuts[i].diff) {
+							cuts[i] = Cut{ diff, Vec2{ x,y } };
 						}
 					}
-
 				}
 			}
+		};
+		m_analysis.Pool().ParallelFor(tiles.size(), cutTask);
+
+		// reduce in outline order: the first best cut wins
+		CCSearch::Path bestPath;
+		int bestDiff = { 0 };
+		size_t bestTile{ 0 };
+		for (size_t i = 0; i < cuts.size(); i++) {
+			if (cuts[i].diff > bestDiff) {
+				bestDiff = cuts[i].diff;
+				bestTile = i;
+			}
+		}
+		if (bestDiff > 0) {
+			Vec2 tile{ tiles[bestTile].first };
+			m_search.FindPath<S>(tile, Vec2{ -1,-1 });
+			bestPath = m_search.GetPath(tile, cuts[bestTile].target);
 		}
 
 		if (!bestPath.empty() && bestDiff - (int)bestPath.size() > 1) {
 			auto& uManager{ m_data->m_uManager };
 
 			cerr << "\tChaine from " << bestPath.front().first << " to " << bestPath.back().first << endl;
-			bestPath.shrink_to_fit();
 			for (auto&[step, level] : bestPath) {
 				if (level == 0) continue; //mInactive
 				uManager.MarkUnitForRemove(step);
 				uManager.RemoveMarkedUnits();
-				m_data->m_me.CreateUnit(level, 1);
+				S::Self(*m_data).CreateUnit(level, 1);
 				m_answer.emplace_back(commands::Train(level, step));
 			
 				// UPDATE UNITS
 			
-				uManager.AddUnit(0, -1, level, step); // -1 is undef id
-				map.m_map[step.y][step.x] = Tile::mActive;
+				uManager.AddUnit(S::owner, -1, level, step); // -1 is undef id
+				map.Set(step, S::active);
 			}
 		}
+		return false;
 	}
 
 	void ReinforceBoarderline() {
 		auto& uManager{ m_data->m_uManager };
 		auto& bManager{ m_data->m_bManager };
-		auto& me{ m_data->m_me };
+		auto& me{ S::Self(*m_data) };
 		auto& map{ m_data->m_map };
 
 		// define tiles which need to reinforce:
-		auto weakTiles = m_search.GetOutline(Tile::mActive);
+		auto weakTiles = m_analysis.Outline<S>();
 
 		cerr << "\t1st Weaklings left on the outline: ";
 		for (auto[pos, score] : weakTiles) {
@@ -1457,76 +4618,61 @@ public:
 		auto Filter = [&](auto & p) {
 			auto pos{ p.first };
 			// kick protected
-			if (this->IsProtected(pos)) return true;
-			// kick tiles without Tile::eActive around
+			if (m_analysis.IsProtected(pos)) return true;
+			// kick tiles without Foe::active around
 			if (!this->HasActiveEnemyNeighbor(pos)) return true;
 			// kick with unit 2,3
 			auto optUnit{ uManager.GetUnitAt(pos) };
 			if (optUnit.has_value() && optUnit->m_level > 1) return true;
 			// kick tiles with enemy Unit 3 as neighbor
-			//if (this->MinMaxLevelAround(pos, Tile::eActive).second == 3) return true;
-			return ( this->MinMaxLevelAround(pos, Tile::eActive).second == 3);
+			//if (m_analysis.FoeLevelsAround<S>(pos).second == 3) return true;
+			return ( m_analysis.FoeLevelsAround<S>(pos).second == 3);
 		};
 		weakTiles.erase( remove_if(weakTiles.begin(), weakTiles.end(), Filter),  weakTiles.end());
 
-		bool isWeak[Map::SIZE][Map::SIZE];
-		for (int i = 0; i < Map::SIZE; i++)
-			for (int j = 0; j < Map::SIZE; j++)
+		bool isWeak[Map::HEIGHT][Map::WIDTH];
+		for (int i = 0; i < Map::HEIGHT; i++)
+			for (int j = 0; j < Map::WIDTH; j++)
 				isWeak[i][j] = false;
 
 		auto IsSpotForTower = [&](Vec2 pos) 
 		{ // is our active tile + not mine spot + wasn't added + without unit
-			if (map.Get(pos) != Tile::mActive || this->IsMineSpot(pos)) return false;
+			if (map.Get(pos) != S::active || this->IsMineSpot(pos)) return false;
 			if (isWeak[pos.y][pos.x]) return false; // already added or will be added from @weakTiles
 			return ( !uManager.GetUnitAt(pos).has_value() );
 		};
 
+		m_towers.Clear(); // the towers of the bridges are built already, see DefendBridges
 		for (const auto&[tile, score] : weakTiles) {
 			isWeak[tile.y][tile.x] = true;
+			m_towers.AddTarget(tile);
 		}
 
-		vector<Vec2> possibleTowerPositions;
+		// every weak tile adds itself and at most 4 neighbors
+		auto AddSpot = [&](Vec2 spot) {
+			// a tower there is lost to enemy unit of level 3
+			if (m_analysis.FoeLevelsAround<S>(spot).second == 3) return;
+			m_towers.AddSpot(spot, m_static->GuardRank(S::owner, spot));
+		};
 		for (const auto&[tile, score] : weakTiles) {
 			auto optUnit{ uManager.GetUnitAt(tile) };
 			if (!optUnit.has_value() && !this->IsMineSpot(tile)) {
-				possibleTowerPositions.emplace_back(tile);
+				AddSpot(tile);
 			}
 			// add all[empty mActive] positions around:
 			auto neighbors = this->AllNeighbors(tile, IsSpotForTower);
 			for (auto neighbor : neighbors) {
-				possibleTowerPositions.emplace_back(neighbor);
+				AddSpot(neighbor);
 			}
 		}
-		
-		auto IsWeakTile = [&isWeak](Vec2 tile) {
-			return isWeak[tile.y][tile.x];
-		};
 
 		array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
 
-		while (me.CanCreateBuilding(sd::towerCost) && !possibleTowerPositions.empty())
+		while (me.CanCreateBuilding(sd::towerCost))
 		{
-			int	mxWeaklings = 0;
-			Vec2 bestTile {0,0};
-
-			for (Vec2 posForTower : possibleTowerPositions) {
-				int weakCount{ (int)this->AllNeighbors(posForTower, IsWeakTile).size() };
-				if (isWeak[posForTower.y][posForTower.x]) weakCount++;
-
-				if (this->MinMaxLevelAround(posForTower, Tile::eActive).second == 3) continue;
-
-				if (weakCount == mxWeaklings && bestTile.Distanse(m_mHQ) > posForTower.Distanse(m_mHQ)) 
-				{
-					mxWeaklings = weakCount;
-					bestTile = posForTower;
-				}
-				else if (weakCount > mxWeaklings) {
-					mxWeaklings = weakCount;
-					bestTile = posForTower;
-				}
-			}
-		
-			if (mxWeaklings < 2) break;
+			auto spot{ m_towers.Next(2) };
+			if (!spot) break;
+			Vec2 bestTile{ *spot };
 			// mark all neighbors as protected
 			for (auto sh : shift) {
 				Vec2 neighbor{ sh + bestTile };
@@ -1538,7 +4684,7 @@ public:
 			me.CreateBuilding(sd::towerCost, 0);
 			m_answer.emplace_back(commands::Build(BType::Tower, bestTile));
 			// UPDATE BUILDINGS
-			bManager.AddBuilding(0, BType::Tower, bestTile);
+			bManager.AddBuilding(S::owner, BType::Tower, bestTile);
 			::cerr << "Defend weak by tower at: " << bestTile << endl;
 		}
 
@@ -1548,8 +4694,8 @@ public:
 			// kick with unit
 			if (uManager.GetUnitAt(pos).has_value()) return true;
 			// kick tiles with enemy Unit 2,3 as neighbor
-			//if (this->MinMaxLevelAround(pos, Tile::eActive).second == 3) return true;
-			return (this->MinMaxLevelAround(pos, Tile::eActive).second > 1);
+			//if (m_analysis.FoeLevelsAround<S>(pos).second == 3) return true;
+			return (m_analysis.FoeLevelsAround<S>(pos).second > 1);
 		};
 		weakTiles.erase(remove_if(weakTiles.begin(), weakTiles.end(), Filter2), weakTiles.end());
 
@@ -1558,7 +4704,6 @@ public:
 			cerr << pos << " ";
 		}
 		cerr << endl;
-		weakTiles.shrink_to_fit();
 		// train
 		while (me.CanCreateUnit(1, 0) && !weakTiles.empty()) {
 			Vec2 bestTile{ weakTiles.front().first};
@@ -1567,7 +4712,7 @@ public:
 			for (auto[pos, score] : weakTiles) {
 				if (!isWeak[pos.y][pos.x]) continue;
 
-				if (pos.Distanse(m_mHQ) <= bestTile.Distanse(m_mHQ)) {
+				if (m_static->FromHQ(S::owner, pos) <= m_static->FromHQ(S::owner, bestTile)) {
 					bestTile = pos;
 					found = true;
 				}
@@ -1580,25 +4725,26 @@ public:
 			me.CreateUnit(1, 0);
 			m_answer.emplace_back(commands::Train(1, bestTile));
 			// UPDATE UNITS
-			uManager.AddUnit(0, -1, 1, bestTile); // -1 is undef id
-			map.m_map[bestTile.y][bestTile.x] = Tile::mActive;
+			uManager.AddUnit(S::owner, -1, 1, bestTile); // -1 is undef id
+			map.Set(bestTile, S::active);
 		}
 	}
 
 	void Train() {
-		this->TryChainAttack();
+		if (this->TryChainAttack()) return;
 		this->DefendFromChainAttack();
 		this->DefendBridges();
 		this->ReinforceBoarderline();
+		// plans first: the greedy steps spend the gold left
+		this->TrainPlan();
 		this->AttackEnemy();
 	}
 
 	void Build() {
-		auto& me{ m_data->m_me };
+		auto& me{ S::Self(*m_data) };
 		auto& uManager{ m_data->m_uManager };
 		auto& bManager{ m_data->m_bManager };
-		bool isMy{ true };
-		auto myMines{ bManager.GetMines(isMy)};
+		auto myMines{ bManager.GetMines(S::owner)};
 
 		int mineCost{ static_cast<int>( sd::minMineCost + 4 * myMines.size()) };
 		if (!me.CanCreateBuilding(mineCost)) return;
@@ -1607,8 +4753,8 @@ public:
 		
 		if (me.m_gold < 100 || myMines.size() >= 2) return;
 
-		sort(mineSpots.begin(), mineSpots.end(), [this](const Mine& lsh,const Mine& rsh) {
-			return lsh.m_pos.Distanse(m_mHQ) < rsh.m_pos.Distanse(m_mHQ);
+		sort(mineSpots.begin(), mineSpots.end(), [this](Vec2 lsh, Vec2 rsh) {
+			return m_static->FromHQ(S::owner, lsh) < m_static->FromHQ(S::owner, rsh);
 		});
 
 		for (auto& mine : mineSpots) {
@@ -1618,18 +4764,18 @@ public:
 			) {
 				me.CreateBuilding(mineCost, 4);
 				m_answer.emplace_back(commands::Build(BType::Mine, mine));
-				bManager.AddBuilding(0, BType::Mine, mine);
+				bManager.AddBuilding(S::owner, BType::Mine, mine);
 				break;
 			}
 		}
 	}
 
-	void Print() {
+	void Print(ostream& out = cout) {
 		for (auto&s : m_answer) {
-			cout << s;
+			out << s;
 		}
-		if (m_answer.empty()) cout << commands::Wait();
-		cout << endl;
+		if (m_answer.empty()) out << commands::Wait();
+		out << endl;
 	}
 private:
 	
@@ -1637,30 +4783,10 @@ private:
 	void DefendBridges() {
 		auto& uManager{ m_data->m_uManager };
 		auto& bManager{ m_data->m_bManager };
-		auto& me{ m_data->m_me };
+		auto& me{ S::Self(*m_data) };
 		auto& map{ m_data->m_map };
 
-		vector<pair<int, Vec2>> values(m_mBridges.size());
-		
-		bool added[Map::SIZE][Map::SIZE];
-		for (int i = 0; i < Map::SIZE; i++)
-			for (int j = 0; j < Map::SIZE; j++)
-				added[i][j] = false;
-
-		for (const auto&[from, to] : m_mBridges) {
-			if (!added[from.y][from.x]) {
-				// calculate bridge value:
-				m_search.Clear();
-				values.emplace_back(m_search.GetScoreAfterBridge(m_mHQ, from, Tile::mActive), from);
-				added[from.y][from.x] = true;
-			}
-			if (!added[to.y][to.x]) {
-				// calculate bridge value:
-				m_search.Clear();
-				values.emplace_back(m_search.GetScoreAfterBridge(m_mHQ, to, Tile::mActive), to);
-				added[to.y][to.x] = true;
-			}
-		}
+		auto values{ m_analysis.CutValues(m_mBridges, S::active) };
 		sort(values.rbegin(), values.rend());
 
 		cerr << "My bridge's worth: [ ";
@@ -1669,9 +4795,42 @@ private:
 		}
 		cerr << " ]"<< endl;
 
+		const int minWorth{ 3 }; // i think it's good to protect at least 2 tiles!
+		// bridge can be nullified by a tower: we can't or it's not worth money otherwise!
+		auto IsExposed = [&](Vec2 bridge) {
+			auto optUnit{ uManager.GetUnitAt(bridge) };
+			int levelOnBridge{ (optUnit.has_value() ? optUnit.value().m_level : 0) };
+			return	this->HasActiveEnemyNeighbor(bridge) &&
+					!m_analysis.IsProtected(bridge) &&
+					levelOnBridge < 2 &&
+					m_analysis.FoeLevelsAround<S>(bridge).second != 3;
+		};
+		/* towers first, before any unit defends a bridge: one of them may cover several bridges.
+		 * Spots are my active tiles only, a tower can't be built on an inactive one.
+		 * Weak tiles get their own planner in ReinforceBoarderline: a bridge is worth a tower alone,
+		 * weak tiles only in pairs, and the gains of one planner can't mix both */
+		m_towers.Clear();
+		for (const auto&[worth, bridge] : values) {
+			if (worth < minWorth) break;
+			if (worth <= sd::towerCost || !IsExposed(bridge)) continue;
+			m_towers.AddTarget(bridge);
+			for (auto spot : this->TowerSpotsAround(bridge)) {
+				m_towers.AddSpot(spot, m_static->GuardRank(S::owner, spot));
+			}
+		}
+		while (me.CanCreateBuilding(sd::towerCost)) {
+			auto spot{ m_towers.Next(1) };
+			if (!spot) break;
+			me.CreateBuilding(sd::towerCost, 0);
+			m_takenPositions.push_back(*spot);
+			m_answer.emplace_back(commands::Build(BType::Tower, *spot));
+			// UPDATE BUILDINGS
+			bManager.AddBuilding(S::owner, BType::Tower, *spot);
+			cerr << "Create bridge-defending building: " << *spot << endl;
+		}
+
 		for (const auto&[worth, bridge ]: values)
 		{ 
-			const int minWorth{ 3 }; // i think it's good to protect at least 2 tiles!
 			if (worth < minWorth) {
 				cerr << bridge << "with worth: "<< worth <<" is worthless bridge!" << endl;
 				break;
@@ -1682,29 +4841,13 @@ private:
 
 			auto optUnit{ uManager.GetUnitAt(bridge) };
 			int levelOnBridge{ (optUnit.has_value() ? optUnit.value().m_level : 0) };
-			bool isProtected { this->IsProtected(bridge) };
-			auto[minLevelTreat, maxLevelTreat] = this->MinMaxLevelAround(bridge, Tile::eActive);
+			bool isProtected { m_analysis.IsProtected(bridge) };
+			auto[minLevelTreat, maxLevelTreat] = m_analysis.FoeLevelsAround<S>(bridge);
 	
-			if (!isProtected
-				&& levelOnBridge < 2
-				&& maxLevelTreat != 3
-			) {// we can't nullify or it's not worth money!
-				auto optTowerPos{ this->GetPositionForTowerAround(bridge) };
+			if (IsExposed(bridge)) 
+			{ // no tower was left for it
 				const int minLevelDefender{ 2 };
-				if (optTowerPos.has_value() &&
-					me.CanCreateBuilding(sd::towerCost) &&
-					!bManager.IsMineSpot(*optTowerPos) && // not a mine spot
-					worth > sd::towerCost
-				) {
-					me.CreateBuilding(sd::towerCost, 0);
-					m_takenPositions.insert(optTowerPos.value());
-					m_answer.emplace_back(commands::Build(BType::Tower, optTowerPos.value()));
-					// UPDATE BUILDINGS
-					bManager.AddBuilding(0, BType::Tower, optTowerPos.value());
-					isProtected = true;
-					cerr << "Create bridge-defending building: " << optTowerPos.value() << endl;
-				}
-				else if (!levelOnBridge &&
+				if (!levelOnBridge &&
 					!bManager.GetBuildingAt(bridge).has_value() &&
 					me.CanCreateUnit(minLevelDefender, 0) &&
 					worth > sd::costByLevel[minLevelDefender - 1] * 2
@@ -1713,7 +4856,7 @@ private:
 					m_answer.emplace_back(commands::Train(minLevelDefender, bridge));
 					// UPDATE UNITS
 					levelOnBridge = minLevelDefender;
-					uManager.AddUnit(0, -1, minLevelDefender, bridge); // -1 is undef id
+					uManager.AddUnit(S::owner, -1, minLevelDefender, bridge); // -1 is undef id
 					cerr << "Create bridge-defending unit: " << bridge << endl;
 				}
 			}
@@ -1722,21 +4865,20 @@ private:
 			minLevelTreat = ( isProtected ? 3 : min(levelOnBridge + 1, 3) );
 			//can be oprimized using lambda as modifier for @trainLevels vector below
 			auto treats{ this->AllNeighbors(bridge, [&map, &uManager,&minLevelTreat](Vec2 pos) {
-					if (map.Get(pos) == Tile::eInactive) return false;
+					if (map.Get(pos) == Foe::inactive) return false;
 					auto optUnit = uManager.GetUnitAt(pos);
 					bool hasTreatningEnemy = (optUnit.has_value()
 						&& optUnit->m_level >= minLevelTreat
-						&& !optUnit->IsMy()); // 1 is id of enemy
-					return  (hasTreatningEnemy || map.Get(pos) == Tile::eActive);
+						&& !S::Owns(optUnit->m_owner)); // 1 is id of enemy
+					return  (hasTreatningEnemy || map.Get(pos) == Foe::active);
 				})
 			};
 			int trainingCost{ 0 };
-			vector<int> trainLevels;
-			trainLevels.reserve(treats.size());
+			StaticVector<int, 4> trainLevels;
 			for (Vec2 p : treats) {
 				auto enemyAround = uManager.GetUnitAt(p);
 				auto level{ enemyAround.has_value() ? enemyAround->m_level : 0 };
-				int needLevelForKill{ this->IsProtected(p) ? 3 : min(level+1, 3) };
+				int needLevelForKill{ m_analysis.IsProtected(p) ? 3 : min(level+1, 3) };
 				trainLevels.emplace_back(needLevelForKill);
 				trainingCost += sd::costByLevel[needLevelForKill-1];
 			}
@@ -1755,8 +4897,8 @@ private:
 					me.CreateUnit(trainLevels[i], 1);
 					m_answer.emplace_back(commands::Train(trainLevels[i], treats[i]));
 					// UPDATE MAP & UNITS
-					map.m_map[treats[i].y][treats[i].x] = Tile::mActive;
-					uManager.AddUnit(0, -1, trainLevels[i], treats[i]); // -1 is undef id
+					map.Set(treats[i], S::active);
+					uManager.AddUnit(S::owner, -1, trainLevels[i], treats[i]); // -1 is undef id
 				}
 				cerr << endl;
 				uManager.RemoveMarkedUnits();
@@ -1764,38 +4906,54 @@ private:
 		}
 	}
 	// CALL ONLY AFTER DEFEND!
+	/* index of the plan with the best worst case: its score minus the best reply
+	 * which the enemy can train next turn, plus the playouts after it when they're on.
+	 * Enemy's moves aren't considered */
+	size_t SafestPlan(const typename TrainBeam<S>::Plans& plans, chrono::steady_clock::time_point deadline) {
+		auto enemy{ Foe::Self(*m_data) };
+		enemy.m_gold += enemy.m_income;
+		typename TrainBeam<Foe>::template Grid<bool> skip{};
+		size_t safest{ 0 };
+		int best{ numeric_limits<int>::min() };
+		if (Config::rollouts) m_rollouts.Setup(*m_data);
+		for (size_t i = 0; i < plans.size(); i++) {
+			auto& plan{ plans[i] };
+			// a reply doesn't gain less than nothing: the rest can't be better
+			if (!Config::rollouts && plan.score <= best) break;
+			auto now{ chrono::steady_clock::now() };
+			if (now >= deadline) break;
+			auto board{ plan.board.Flipped() };
+			int reply{ sd::mxScore };
+			if (m_replies.ChainCost(*m_data, board) > enemy.m_gold) {
+				auto slice{ (deadline - now) / static_cast<int>(plans.size() - i) };
+				reply = m_replies.Search(*m_data, board, enemy, *m_static, skip, now + slice).front().score;
+			}
+			int worst{ plan.score - reply };
+			if (Config::rollouts) {
+				auto outcome{ m_rollouts.Evaluate(plan.board, plan.me, Foe::Self(*m_data), Config::horizon, Config::rollouts) };
+				worst += static_cast<int>(outcome.value);
+			}
+			cerr << "\tplan " << i << ": " << plan.score << " - reply " << reply << " -> " << worst << endl;
+			if (worst > best) {
+				best = worst;
+				safest = i;
+			}
+		}
+		return safest;
+	}
+
 	void AttackEnemy() {
 		//declaration:
 		auto& uManager{ m_data->m_uManager };
-		auto& bManager{ m_data->m_bManager };
-		auto& me{ m_data->m_me };
+		auto& me{ S::Self(*m_data) };
 		auto& map{ m_data->m_map };
 		array<Vec2, 4> shift{ Vec2{-1, 0}, {0, -1}, {0, 1}, {1, 0} };
 		//get tiles on the boarder
-		auto tiles{ m_search.GetBoarderTiles(Tile::mActive) };
+		auto tiles{ m_analysis.Frontier<S>() };
 
-		bool added[Map::SIZE][Map::SIZE];
-		for (int i = 0; i < Map::SIZE; i++)
-			for (int j = 0; j < Map::SIZE; j++)
-				added[i][j] = false;
-		// sort enemy bridges by score, keep position
-		vector<pair<int, Vec2>> bridges;
-		bridges.reserve(m_eBridges.size());
-		for (auto [from, to] : m_eBridges) {
-			if (!added[from.y][from.x]) {
-				// calculate bridge value:
-				m_search.Clear();
-				bridges.emplace_back(m_search.GetScoreAfterBridge(m_eHQ, from, Tile::eActive), from);
-				added[from.y][from.x] = true;
-			}
-			if (!added[to.y][to.x]) {
-				// calculate bridge value:
-				m_search.Clear();
-				bridges.emplace_back(m_search.GetScoreAfterBridge(m_eHQ, to, Tile::eActive), to);
-				added[to.y][to.x] = true;
-			}
-		}
-		bridges.shrink_to_fit();
+		// sort enemy bridges by score, keep position: the plan may have cut some of them
+		m_eBridges = m_analysis.Bridges(Foe::active);
+		auto bridges{ m_analysis.CutValues(m_eBridges, Foe::active) };
 		sort(bridges.rbegin(), bridges.rend());
 
 		cerr << "Enemy bridge's worth: [ ";
@@ -1806,8 +4964,7 @@ private:
 
 		// Find all intersections (bridges under attack) where:
 		// bridges INTERSECT tilesOnBoarder
-		vector<pair<int , Vec2>> bridgesUnderAttack;
-		bridgesUnderAttack.reserve(10);
+		StaticVector<pair<int , Vec2>, Map::AREA> bridgesUnderAttack;
 		for (auto [worth, bridge] : bridges) {
 			for (auto [boarderTile, score] : tiles) {
 				if (bridge == boarderTile) { // we can attack bridge
@@ -1819,7 +4976,7 @@ private:
 		// solve bridges that we can attack in online style (update map & unit & building data after each case):
 		// NOTE: It's just erase connected component after the bridge.
 		// It doesn't update/search for new bridges after removing current one
-		vector<Vec2> solved;
+		StaticVector<Vec2, Map::AREA> solved;
 		for (const auto& [worth, bridge] : bridgesUnderAttack) {
 			// i think it's important to erase bridges where |CC| >= minWorth
 			// it also can be unit
@@ -1828,14 +4985,14 @@ private:
 				cerr << bridge << " is worthless enemy bridge!" << endl;
 				break;
 			}
-			if (map.Get(bridge) == Tile::eInactive) {
+			if (map.Get(bridge) == Foe::inactive) {
 				solved.emplace_back(bridge);
 				continue;
 			}
 
 			auto optUnit{ uManager.GetUnitAt(bridge) };
 			int levelOnBridge{ (optUnit.has_value() ? optUnit.value().m_level : 0) };
-			bool isProtected{ this->IsProtected(bridge) };
+			bool isProtected{ m_analysis.IsProtected(bridge) };
 			int attackerLevel{ isProtected ? 3 : min(levelOnBridge + 1, 3) };
 
 			int cost{ sd::costByLevel[attackerLevel - 1] };
@@ -1848,34 +5005,35 @@ private:
 				me.CreateUnit(attackerLevel, 1);
 				m_answer.emplace_back(commands::Train(attackerLevel, bridge));
 				// UPDATE MAP & UNITS
-				map.m_map[bridge.y][bridge.x] = Tile::mActive;
-				uManager.AddUnit(0, -1, attackerLevel, bridge); // -1 is undef id
+				map.Set(bridge, S::active);
+				uManager.AddUnit(S::owner, -1, attackerLevel, bridge); // -1 is undef id
 				cerr << "Attack bridge by unit: " << bridge << endl;
 				// MAKE INACTIVE EVERY TILE AFTER BRIDGE!
 				m_search.Clear();
-				m_search.ChangeTilesAfterTheBridge(m_eHQ, bridge, Tile::eActive, Tile::eInactive);
+				m_search.ChangeTilesAfterTheBridge(m_eHQ, bridge, Foe::active, Foe::inactive);
 			}
 		}
 //STEP 2: 
 		// ALSO ONLINE:
 		int hasTerritory{ true };
 		int expandTeamLevel{ 1 };
-		bool isMarked[Map::SIZE][Map::SIZE];
+		bool isMarked[Map::HEIGHT][Map::WIDTH];
+		m_contest.Build(map);
 
 		while (hasTerritory) {
 			if (!me.CanCreateUnit(expandTeamLevel, 1)) break;
 
-			tiles = m_search.GetBoarderTiles(Tile::mActive);
+			tiles = m_analysis.Frontier<S>();
 			// MARK FOR LEVEL 1
 			// mark next possible steps of my units for spreading:
-			for (int i = 0; i < Map::SIZE; i++) {
-				for (int j = 0; j < Map::SIZE; j++) {
+			for (int i = 0; i < Map::HEIGHT; i++) {
+				for (int j = 0; j < Map::WIDTH; j++) {
 					isMarked[i][j] = false;
 				}
 			}
 			//mark neutral tiles for the next step of existing units to avoid stucking!
 			for (const auto& unit : uManager.m_units) {
-				if (unit.IsMy()) {
+				if (S::Owns(unit.m_owner)) {
 					for (auto sh : shift) {
 						Vec2 neighbor{ unit.m_pos + sh };
 						if (IsValid(neighbor) && map.Get(neighbor) == Tile::neutral) {
@@ -1888,7 +5046,7 @@ private:
 			
 			auto TileFilter = [&](const auto& p) {
 				return (isMarked[p.first.y][p.first.x] ||
-						this->IsProtected(p.first) ||
+						m_analysis.IsProtected(p.first) ||
 						map.Get(p.first) == Tile::blocked ||
 						uManager.GetUnitAt(p.first).has_value()
 				);
@@ -1901,24 +5059,15 @@ private:
 
 			if (tiles.empty()) break;
 			// score all bridges
-			int bridgeScores[Map::SIZE][Map::SIZE];
-			for (int i = 0; i < Map::SIZE; i++) {
-				for (int j = 0; j < Map::SIZE; j++) {
+			int bridgeScores[Map::HEIGHT][Map::WIDTH];
+			for (int i = 0; i < Map::HEIGHT; i++) {
+				for (int j = 0; j < Map::WIDTH; j++) {
 					bridgeScores[i][j] = 0;
 				}
 			}
-			this->UpdateEnemyBridge();
-			for (auto[from, to] : m_eBridges) {
-				if (!bridgeScores[from.y][from.x]) {
-					// calculate bridge value:
-					m_search.Clear();
-					bridgeScores[from.y][from.x] = m_search.GetScoreAfterBridge(m_eHQ, from, Tile::eActive);
-				}
-				if (!bridgeScores[to.y][to.x]) {
-					// calculate bridge value:
-					m_search.Clear();
-					bridgeScores[to.y][to.x] = m_search.GetScoreAfterBridge(m_eHQ, to, Tile::eActive);
-				}
+			m_eBridges = m_analysis.Bridges(Foe::active);
+			for (auto[worth, bridge] : m_analysis.CutValues(m_eBridges, Foe::active)) {
+				bridgeScores[bridge.y][bridge.x] = worth;
 			}
 
 			// score expansion:
@@ -1931,33 +5080,22 @@ private:
 				if (bridgeScores[tile.y][tile.x]) {
 					score = bridgeScores[tile.y][tile.x];
 				}
-				else if (type == Tile::eActive)
+				else if (type == Foe::active)
 					score = sd::activeTileScore + (this->IsMine(tile) ? sd::minMineCost : 0);
-				else if (type == Tile::eInactive)
+				else if (type == Foe::inactive)
 					score = sd::inactiveTileScore;
-				else
-					score = sd::defaultScore;
+				else // contested tiles the enemy would take otherwise
+					score = sd::defaultScore + m_contest.Value(S::owner, tile);
 				// look for inactive component around our tile
 				// how much we will get if activate?
 				for (auto&sh : shift) {
 					auto neighbor{ sh + tile };
-					if (!IsValid(neighbor) || map.Get(neighbor) != Tile::mInactive) continue;
-					auto pred = [&map](Vec2 p) {
-						return (map.Get(p) == Tile::mInactive);
-					};
-					auto calc = [&bManager](Vec2 p) {
-						auto optBuilding{ bManager.GetBuildingAt(p) };
-						int res{ 0 };
-						if (optBuilding.has_value()) {
-							res += (optBuilding.value().IsTower() ? sd::towerCost : sd::minMineCost);
-						}
-						return res;
-					};
-					m_search.Clear();
-					m_search.Dfs<decltype(pred), decltype(calc)>(neighbor, score, pred, calc);
+					if (!IsValid(neighbor) || map.Get(neighbor) != S::inactive) continue;
+					auto component{ m_analysis.InactiveComponent<S>(neighbor) };
+					score += component->towers * sd::towerCost + component->mines * sd::minMineCost;
 				}
 
-				if (maxScore == score && bestTile.Distanse(m_eHQ) > tile.Distanse(m_eHQ)) 
+				if (maxScore == score && m_static->FromHQ(Foe::owner, bestTile) > m_static->FromHQ(Foe::owner, tile)) 
 				{
 					maxScore = score;
 					bestTile = tile;
@@ -1975,189 +5113,855 @@ private:
 			me.CreateUnit(expandTeamLevel, 1);
 			m_answer.emplace_back(commands::Train(expandTeamLevel, bestTile));
 			// UPDATE UNITS
-			uManager.AddUnit(0, -1, expandTeamLevel, bestTile); // -1 is undef id
-			map.m_map[bestTile.y][bestTile.x] = Tile::mActive;
-			hasTerritory = true;
-		}
-// STEP 3:
-		hasTerritory = true;
-		const int negative = -10'000'000;
-		while (hasTerritory) {
-			hasTerritory = false;
-			tiles = m_search.GetBoarderTiles(Tile::mActive);
-			tuple<int, Vec2, int> bestResult { negative, Vec2{0,0}, 0 };
-			// precalculation of all tiles:
-			this->UpdateEnemyBridge();
-			// score all bridges
-			int bridgeScores[Map::SIZE][Map::SIZE];
-			for (int i = 0; i < Map::SIZE; i++) {
-				for (int j = 0; j < Map::SIZE; j++) {
-					bridgeScores[i][j] = 0;
-				}
-			}
-			for (auto[from, to] : m_eBridges) {
-				if (!bridgeScores[from.y][from.x]) {
-					// calculate bridge value:
-					m_search.Clear();
-					bridgeScores[from.y][from.x] = m_search.GetScoreAfterBridge(m_eHQ, from, Tile::eActive);
-				}
-				if (!bridgeScores[to.y][to.x]) {
-					// calculate bridge value:
-					m_search.Clear();
-					bridgeScores[to.y][to.x] = m_search.GetScoreAfterBridge(m_eHQ, to, Tile::eActive);
-				}
-			}
-			for (auto& [tile, score] : tiles)
-			{ // check whether we already have solved this one (if it was bridge
-				score = 0;
-				if (!solved.empty()) {
-					auto solvedIt = find_if(solved.begin(), solved.end(), [&tile](auto&pos) { return pos == tile; });
-					if (solvedIt != solved.end()) {
-					// to not chose this tile for the training command
-						continue;
-					}
-				}
-				if (m_eHQ == tile) {
-					bestResult = { sd::mxScore, tile, sd::costByLevel[0] };
-					break;
-				}
-
-				auto optEnemy{ uManager.GetUnitAt(tile) };
-				auto optBuilding{ bManager.GetBuildingAt(tile) };
-				bool isProtected{ this->IsProtected(tile) };
-				int enemyLevel{ optEnemy.has_value() ? optEnemy->m_level : 0 };
-				int attackerLevel{ isProtected ? 3 : min(enemyLevel + 1, 3) };
-
-				// ignore level 3 unit as attacker:
-				// to have opportunity to attack
-				bool isEnough{ (me.m_gold > 45 && me.m_income > 30) || me.m_gold >= 90 };
-				if (attackerLevel == 3 && !isEnough) continue; // don't choose level 3
-				if (!me.CanCreateUnit(attackerLevel, 1)) continue;
-				
-				// score all other cases:
-				score = sd::defaultScore;
-				if (map.Get(tile) == Tile::eActive) {
-					score = sd::activeTileScore;
-				}
-				else if (map.Get(tile) == Tile::eInactive) {
-					score = sd::inactiveTileScore;
-				}
-
-				if (map.Get(tile) != Tile::neutral) {
-					if (optBuilding.has_value()) {
-						score += (optBuilding.value().IsTower() ? sd::towerCost : sd::minMineCost);
-					}
-					else if (enemyLevel) {
-						score += sd::costByLevel[enemyLevel - 1];
-					}
-				}
-
-				//check if it's bridge
-				if (bridgeScores[tile.y][tile.x]) {
-					int bridgeWorth{ bridgeScores[tile.y][tile.x] - sd::costByLevel[attackerLevel - 1] };
-					int best{ get<0>(bestResult) - get<2>(bestResult) };// score - cost
-					if (bridgeWorth > best) {
-						score = bridgeScores[tile.y][tile.x];
-						//bestResult = {score, tile, sd::costByLevel[attackerLevel - 1] };
-					}
-				}
-				
-				// look for inactive component around our tile
-				// how much we will get if activate?
-				for (auto&sh : shift) {
-					auto neighbor{ sh + tile };
-					if (!IsValid(neighbor) || map.Get(neighbor) != Tile::mInactive) continue;
-					auto pred = [&map](Vec2 p) {
-						return (map.Get(p) == Tile::mInactive);
-					};
-					auto calc = [&bManager](Vec2 p) {
-						auto optBuilding{ bManager.GetBuildingAt(p) };
-						int res{ 0 };
-						if (optBuilding.has_value()) {
-							res += (optBuilding.value().IsTower() ? sd::towerCost : sd::minMineCost);
-						}
-						return res;
-					};
-					m_search.Clear();
-					m_search.Dfs<decltype(pred), decltype(calc)>(neighbor, score, pred, calc);
-				}
-
-				int deltaCur{ score - sd::costByLevel[attackerLevel - 1] };
-				int deltaBest{ get<0>(bestResult) - get<2>(bestResult) };
-
-				if (deltaCur == deltaBest && get<1>(bestResult).Distanse(m_eHQ) > tile.Distanse(m_eHQ)) 
-				{
-					bestResult = { score, tile, sd::costByLevel[attackerLevel - 1] };
-				}
-				else if (deltaCur > deltaBest) {
-					bestResult = { score, tile, sd::costByLevel[attackerLevel - 1] };
+			uManager.AddUnit(S::owner, -1, expandTeamLevel, bestTile); // -1 is undef id
+			map.Set(bestTile, S::active);
+			// our inactive territory around is connected again
+			RingQueue<Vec2, Map::AREA> Q;
+			Q.push(bestTile);
+			while (!Q.empty()) {
+				auto top{ Q.front() };
+				Q.pop();
+				for (auto& sh : shift) {
+					auto to{ top + sh };
+					if (!IsValid(to) || map.Get(to) != S::inactive) continue;
+					map.Set(to, S::active);
+					Q.push(to);
 				}
 			}
-
-			// Start Attack!
-			cerr << "Best target for attack:(score|pos|cost): ";
-			cerr << "[" << get<0>(bestResult) << " " << get<1>(bestResult) << " " << get<2>(bestResult) << "];" << endl;
-			int level{ 1 };
-			for (int i = 1; i <= 3; i++) {
-				int x{ sd::costByLevel[i - 1] };
-				if (get<2>(bestResult) == x) {
-					level = i;
-					break;
-				}
+			m_contest.Claim(map, S::owner, bestTile);
+			hasTerritory = true;
+		}
+	}
+	// sequences of trainings within the time left, the safest of the best plans is trained
+	void TrainPlan() {
+		auto& uManager{ m_data->m_uManager };
+		auto& me{ S::Self(*m_data) };
+		auto& map{ m_data->m_map };
+		typename TrainBeam<S>::template Grid<bool> skip{};
+		auto deadline{ m_deadline - Config::reserve };
+		auto now{ chrono::steady_clock::now() };
+		// half of the time left for the plans, the rest for the replies
+		auto plans{ m_beam.Search(*m_data, Board::Of(*m_data, S::owner), me, *m_static, skip, now + (deadline - now) / 2) };
+		cerr << "Beam: " << plans.front().trains.size() << " trainings for " << plans.front().score << ", width "
+			<< m_beam.Width() << ", " << m_beam.Expanded() << " states" << endl;
+		auto safest{ this->SafestPlan(plans, deadline) };
+		auto& plan{ plans[safest] };
+		if (safest) cerr << "Safest is plan " << safest << " of " << plans.size() << ": " << plan.score << " for " << plan.trains.size() << " trainings" << endl;
+		if (plan.trains.empty()) return;
+		for (auto[pos, level] : plan.trains) {
+			auto enemy{ uManager.GetUnitAt(pos) };
+			if (enemy.has_value() && Foe::Owns(enemy->m_owner)) {
+				uManager.MarkUnitForRemove(pos);
+				uManager.RemoveMarkedUnits();
 			}
-		
-			if (me.CanCreateUnit(level, 1) && get<0>(bestResult) > get<2>(bestResult)) 
-			{
-				if (level > 1) {
-					uManager.MarkUnitForRemove(get<1>(bestResult));
-					uManager.RemoveMarkedUnits();
+			cerr << "Creating attacker at " << pos << endl;
+			me.CreateUnit(level, 1);
+			m_answer.emplace_back(commands::Train(level, pos));
+			// UPDATE UNITS
+			uManager.AddUnit(S::owner, -1, level, pos); // -1 is undef id
+			map.Set(pos, S::active);
+		}
+		// territory cut off or connected again by the trainings
+		for (int y = 0; y < Map::HEIGHT; y++) {
+			for (int x = 0; x < Map::WIDTH; x++) {
+				Vec2 p{ x, y };
+				if (plan.board.units[y][x] == 0 && map.Get(p) != plan.board.tiles[y][x]) {
+					auto unit{ uManager.GetUnitAt(p) };
+					if (unit.has_value() && Foe::Owns(unit->m_owner)) uManager.MarkUnitForRemove(p);
 				}
-				cerr << "Creating attacker at " << get<1>(bestResult) << endl;
-				me.CreateUnit(level, 1);
-				m_answer.emplace_back(commands::Train(level, get<1>(bestResult)));
-				// UPDATE UNITS
-				uManager.AddUnit(0, -1, level, get<1>(bestResult)); // -1 is undef id
-				map.m_map[get<1>(bestResult).y][get<1>(bestResult).x] = Tile::mActive;
-				hasTerritory = true;
+				map.Set(p, plan.board.tiles[y][x]);
 			}
 		}
+		uManager.RemoveMarkedUnits();
 	}
 
 private:
 	Data* m_data;
-	vector<pair<Vec2, Vec2> > m_mBridges, m_eBridges;
+	const StaticMap* m_static;
+	BridgeList m_mBridges, m_eBridges;
 	// deduced:
 	Vec2 m_mHQ, m_eHQ;
 
-	set<Vec2>  m_takenPositions;
-	vector<string> m_answer;
+	const PonderResult* m_pondered{ nullptr };
+	StaticVector<Vec2, Map::AREA>  m_takenPositions;
+	// each tile gets at most one move, one train and one build per turn
+	StaticVector<Command, 3 * Map::AREA + 1> m_answer;
+	mt19937 m_rng;
 
 	CCSearch m_search;
-	Bridges m_bridges;
+	TurnAnalysis m_analysis;
+	// kept across turns: searched again only when the blocking pattern changes
+	FlowField m_toEnemyHQ, m_toMines, m_toFrontier;
+	int m_flowSearches{ 0 };
+	ContestMap m_contest;
+	ChainTree m_chainTree;
+	ChainPlanner m_planner;
+	TowerPlanner m_towers;
+	TrainBeam<S> m_beam;
+	TrainBeam<Foe> m_replies;
+	Rollouts<S> m_rollouts;
+	StaticVector<int, Map::AREA> m_moved; // ids of units which got a move this turn
+	chrono::steady_clock::time_point m_deadline{ chrono::steady_clock::time_point::max() };
 };
+// nothing plays it yet: keeps the code of both sides compiling
+template class Commander<EnemySide>;
 
 struct Game {
 	
-	Game() : m_commander(&m_data) {};
+	Game() : m_commander(&m_data, &m_static) {};
 
 	void Loop() {
 		m_data.Init();
-		while (true) {
+		if (Config::ponder) m_ponderer.emplace();
+		for (int turn = 1; ; turn++) {
+#ifdef _DEBUG
+			size_t allocationsBefore{ allocations::g_count };
+#endif
 			m_data.Update();
+			auto turnStart{ chrono::steady_clock::now() };
+			bool first{ !m_static.IsBuilt() };
+			m_commander.SetDeadline(turnStart + (first ? Config::firstTurnTime : Config::turnTime));
+			// the state before the turn for the watchdog: encoding doesn't allocate
+			bool recorded{ replay::Encode(m_data, m_record) };
+			auto seed{ static_cast<uint32_t>(m_seeds()) };
+			m_commander.Seed(seed);
+			Phases phases{ turnStart };
+			if (first) {
+				// first turn has 1000 ms
+				auto start{ chrono::steady_clock::now() };
+				m_static.Build(m_data);
+				auto spent{ chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start) };
+				cerr << "Static tables are built in " << spent.count() << " us, "
+					<< m_static.Searches() << " bfs, symmetric: " << m_static.IsSymmetric() << endl;
+			}
+			phases.Mark(Phases::STATIC);
 			m_commander.Clear();
+			if (m_ponderer.has_value()) m_commander.SetPondered(m_ponderer->Stop());
+			phases.Mark(Phases::PONDER);
 			m_commander.Update();
+			phases.Mark(Phases::UPDATE);
 
 			m_commander.Move();
+			phases.Mark(Phases::MOVE);
 			m_commander.Train();
+			phases.Mark(Phases::TRAIN);
 			m_commander.Build();
+			phases.Mark(Phases::BUILD);
 			m_commander.Print();
+			phases.Mark(Phases::PRINT);
+			if (recorded) this->Watch(turn, seed, phases, first);
+			if (m_ponderer.has_value()) m_ponderer->Start(m_data);
+#ifdef _DEBUG
+			cerr << "Heap allocations this turn: " << allocations::g_count - allocationsBefore << endl;
+#endif
 		}
 	}
 private:
+	// time of every phase of a turn
+	struct Phases {
+		enum { STATIC, PONDER, UPDATE, MOVE, TRAIN, BUILD, PRINT, COUNT };
+		static constexpr const char* NAMES[COUNT]{ "static", "ponder", "update", "move", "train", "build", "print" };
+
+		explicit Phases(chrono::steady_clock::time_point start) : m_last(start) {}
+		// the time since the previous mark goes to @phase
+		void Mark(int phase) noexcept {
+			auto now{ chrono::steady_clock::now() };
+			m_spent[phase] = chrono::duration_cast<chrono::microseconds>(now - m_last);
+			m_last = now;
+		}
+		chrono::microseconds Total() const noexcept {
+			chrono::microseconds total{ 0 };
+			for (auto spent : m_spent) total += spent;
+			return total;
+		}
+
+		chrono::steady_clock::time_point m_last;
+		chrono::microseconds m_spent[COUNT]{};
+	};
+	/* a slow turn is captured as the input which replays it, after a '#' line with its seed and phases.
+	 * It's written after the answer, so only the next turn pays for it */
+	void Watch(int turn, uint32_t seed, const Phases& phases, bool first) {
+		auto total{ phases.Total() };
+		if (total < (first ? chrono::microseconds{ Config::firstTurnTime } : chrono::microseconds{ Config::slowTurn })) return;
+		auto snapshot{ make_unique<Data>() };
+		snapshot->m_bManager.m_mines = m_data.m_bManager.m_mines;
+		auto buffer{ cerr.rdbuf(nullptr) }; // the delta of the snapshot isn't news
+		replay::Decode(m_record, *snapshot);
+		cerr.clear();
+		cerr.rdbuf(buffer);
+
+		ofstream file;
+		if (!Config::captureFile.empty()) file.open(Config::captureFile, ios::app);
+		ostream& out{ file.is_open() ? file : cerr };
+		out << "# slow turn " << turn << " seed " << seed << " total " << total.count();
+		for (int i = 0; i < Phases::COUNT; i++) out << " " << Phases::NAMES[i] << " " << phases.m_spent[i].count();
+		out << "\n";
+		replay::Print(*snapshot, out, true);
+		out.flush();
+	}
+
 	Data m_data;
-	Commander m_commander;
+	StaticMap m_static;
+	Commander<MySide> m_commander;
+	optional<Ponderer> m_ponderer;
+	replay::TurnRecord m_record;
+	mt19937 m_seeds{ random_device{}() };
+};
+
+/* offline runs of the bot on recorded states */
+namespace tools
+{
+	// logs are dropped while it's alive
+	struct Muted {
+		Muted() : m_buffer(cerr.rdbuf(nullptr)) {}
+		~Muted() {
+			cerr.clear();
+			cerr.rdbuf(m_buffer);
+		}
+		streambuf* m_buffer;
+	};
+	// @read takes @input as if it came from the referee
+	template <class Read>
+	void Feed(const string& input, Read read) {
+		istringstream in{ input };
+		auto buffer{ cin.rdbuf(in.rdbuf()) };
+		read();
+		cin.rdbuf(buffer);
+	}
+
+	// one mid-game turn on @state (mine spots, then a turn of the referee), the answer goes to @out
+	// and the time the commander spent to @spent; the logs are muted
+	void RunTurn(const string& state, ostream& out, chrono::microseconds& spent) {
+		Muted muted;
+		auto coutBuffer{ cout.rdbuf(out.rdbuf()) };
+		auto data{ make_unique<Data>() };
+		auto tables{ make_unique<StaticMap>() };
+		Feed(state, [&data] {
+			data->Init();
+			data->Update();
+		});
+		tables->Build(*data);
+		auto commander{ make_unique<Commander<MySide>>(data.get(), tables.get()) };
+
+		auto start{ chrono::steady_clock::now() };
+		commander->SetDeadline(start + Config::turnTime);
+		commander->Clear();
+		commander->Update();
+		commander->Move();
+		commander->Train();
+		commander->Build();
+		commander->Print();
+		spent = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+		cout.rdbuf(coutBuffer);
+	}
+
+	// '#' lines are notes like the ones of captured turns, @seed is taken from them; false at the end of @in
+	bool SkipComments(istream& in, uint32_t* seed = nullptr) {
+		while ((in >> ws) && in.peek() == '#') {
+			string line;
+			getline(in, line);
+			auto at{ line.find(" seed ") };
+			if (seed && at != string::npos) *seed = static_cast<uint32_t>(stoul(line.substr(at + 6)));
+		}
+		return in.good() && in.peek() != char_traits<char>::eof();
+	}
+	// text states, @turns per game after its mine spots, into a binary corpus
+	bool Pack(const string& text, const string& corpus, int turns) {
+		ifstream in{ text };
+		replay::Writer writer{ corpus };
+		if (!in || !writer.IsOpen()) return false;
+		Muted muted;
+		auto buffer{ cin.rdbuf(in.rdbuf()) };
+		bool packed{ true };
+		while (packed && SkipComments(in)) {
+			auto data{ make_unique<Data>() };
+			data->Init();
+			packed = writer.Begin(*data);
+			for (int i = 0; packed && i < turns; i++) {
+				SkipComments(in);
+				data->Update();
+				packed = writer.Add(*data);
+			}
+		}
+		cin.rdbuf(buffer);
+		return packed;
+	}
+	// the corpus back as text: the games one after another
+	bool Unpack(const string& corpus, ostream& out) {
+		replay::Corpus records{ corpus };
+		if (!records.IsOpen()) return false;
+		Muted muted;
+		for (size_t i = 0; i < records.Games(); i++) {
+			auto& game{ records.Game(i) };
+			auto data{ make_unique<Data>() };
+			replay::Decode(game, *data);
+			for (size_t turn = game.first; turn < game.first + game.turns; turn++) {
+				replay::Decode(records.Turn(turn), *data);
+				replay::Print(*data, out, turn == game.first);
+			}
+		}
+		return true;
+	}
+	/* rollouts of @count playouts over @horizon turns on generated positions, as SafestPlan runs them:
+	 * playouts per second go to @out. False if an evaluation with the same seed doesn't repeat itself */
+	bool Playouts(uint32_t seed, int positions, int horizon, int count, ostream& out) {
+		StateGenerator generator{ seed };
+		Rollouts<MySide> rollouts{ seed };
+		chrono::microseconds spent{ 0 };
+		long long playouts{ 0 };
+		double wins{ 0 }, losses{ 0 };
+		for (int i = 0; i < positions; i++) {
+			generator.Generate(-1);
+			ostringstream text;
+			generator.Print(text);
+			auto data{ make_unique<Data>() };
+			{
+				Muted muted;
+				Feed(text.str(), [&data] {
+					data->Init();
+					data->Update();
+				});
+			}
+			auto board{ Board::Of(*data, MySide::owner) };
+			rollouts.Setup(*data);
+			rollouts.Seed(seed + static_cast<uint32_t>(i));
+			auto start{ chrono::steady_clock::now() };
+			auto outcome{ rollouts.Evaluate(board, data->m_me, data->m_enemy, horizon, count) };
+			spent += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+			rollouts.Seed(seed + static_cast<uint32_t>(i));
+			auto again{ rollouts.Evaluate(board, data->m_me, data->m_enemy, horizon, count) };
+			if (again.value != outcome.value || again.wins != outcome.wins || again.losses != outcome.losses) {
+				cerr << "Position " << i << " evaluates to " << outcome.value << " then to " << again.value << " with the same seed" << endl;
+				out << text.str();
+				return false;
+			}
+			playouts += outcome.playouts;
+			wins += outcome.wins, losses += outcome.losses;
+		}
+		out << playouts << " playouts of " << horizon << " turns in " << spent.count() << " us: "
+			<< static_cast<long long>(playouts * 1e6 / max<long long>(spent.count(), 1)) << " per second, wins "
+			<< wins / max(positions, 1) << ", losses " << losses / max(positions, 1) << endl;
+		return true;
+	}
+
+	/* recorded states through the whole pipeline in one process. A worker keeps its data, tables and commander
+	 * for all of its games as the bot keeps them for all turns, games are sharded over the workers */
+	class Batch {
+	public:
+		// text states with the seeds of captured turns in their '#' lines, or a binary corpus
+		bool Load(const string& path) {
+			m_corpus = make_unique<replay::Corpus>(path);
+			if (m_corpus->IsOpen()) {
+				for (size_t i = 0; i < m_corpus->Games(); i++) {
+					auto& game{ m_corpus->Game(i) };
+					m_jobs.push_back(Job{ &game, &m_corpus->Turn(game.first), game.turns, 0, m_states });
+					m_states += game.turns;
+				}
+				return true;
+			}
+			// every text state is a game of one turn
+			ifstream in{ path };
+			if (!in) return false;
+			Muted muted;
+			auto buffer{ cin.rdbuf(in.rdbuf()) };
+			vector<uint32_t> seeds;
+			for (uint32_t seed{ 0 }; SkipComments(in, &seed); seed = 0) {
+				auto data{ make_unique<Data>() };
+				data->Init();
+				data->Update();
+				auto& game{ m_games.emplace_back() };
+				auto& turn{ m_turns.emplace_back() };
+				if (!replay::Encode(*data, game) || !replay::Encode(*data, turn)) {
+					m_games.pop_back();
+					m_turns.pop_back();
+					continue;
+				}
+				seeds.push_back(seed);
+			}
+			cin.rdbuf(buffer);
+			for (size_t i = 0; i < m_games.size(); i++) {
+				m_jobs.push_back(Job{ &m_games[i], &m_turns[i], 1, seeds[i], m_states++ });
+			}
+			return true;
+		}
+		// the answer of every state after a '#' line with its index and time
+		void Run(size_t threads, ostream& out) {
+			threads = max<size_t>(threads, 1);
+			vector<Result> results(m_states);
+			auto start{ chrono::steady_clock::now() };
+			{
+				Muted muted;
+				if (threads == 1) this->Work(0, 1, results);
+				else {
+					vector<thread> workers;
+					for (size_t w = 0; w < threads; w++) {
+						workers.emplace_back(&Batch::Work, this, w, threads, ref(results));
+					}
+					for (auto& worker : workers) worker.join();
+				}
+			}
+			auto wall{ chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start) };
+
+			chrono::microseconds total{ 0 }, slowest{ 0 };
+			size_t slowestState{ 0 };
+			for (size_t i = 0; i < results.size(); i++) {
+				out << "# " << i << " " << results[i].spent.count() << " us\n" << results[i].answer;
+				total += results[i].spent;
+				if (results[i].spent > slowest) slowest = results[i].spent, slowestState = i;
+			}
+			cerr << results.size() << " states in " << wall.count() << " ms on " << threads << " threads, turn "
+				<< total.count() / max<size_t>(results.size(), 1) << " us on average, " << slowest.count()
+				<< " us at most (state " << slowestState << ")" << endl;
+		}
+	private:
+		struct Job {
+			const replay::GameRecord* game;
+			const replay::TurnRecord* turns;
+			size_t count;
+			uint32_t seed;
+			size_t first; // index of its first state
+		};
+		struct Result {
+			string answer;
+			chrono::microseconds spent{ 0 };
+		};
+
+		void Work(size_t worker, size_t workers, vector<Result>& results) {
+			auto data{ make_unique<Data>() };
+			auto tables{ make_unique<StaticMap>() };
+			auto commander{ make_unique<Commander<MySide>>(data.get(), tables.get()) };
+			ostringstream answer;
+			for (size_t i = worker; i < m_jobs.size(); i += workers) {
+				auto& job{ m_jobs[i] };
+				replay::Decode(*job.game, *data);
+				for (size_t turn = 0; turn < job.count; turn++) {
+					replay::Decode(job.turns[turn], *data);
+					if (turn == 0) tables->Build(*data);
+					commander->Seed(job.seed + static_cast<uint32_t>(turn));
+					auto start{ chrono::steady_clock::now() };
+					commander->SetDeadline(start + Config::turnTime);
+					commander->Clear();
+					commander->Update();
+					commander->Move();
+					commander->Train();
+					commander->Build();
+					commander->Print(answer);
+					auto& result{ results[job.first + turn] };
+					result.spent = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+					result.answer = answer.str();
+					answer.str({});
+				}
+			}
+		}
+
+		unique_ptr<replay::Corpus> m_corpus;
+		// states of a text file
+		vector<replay::GameRecord> m_games;
+		vector<replay::TurnRecord> m_turns;
+		vector<Job> m_jobs;
+		size_t m_states{ 0 };
+	};
+
+	/* optimized paths of the bot against the reference kernels run from scratch on the same state:
+	 * views of TurnAnalysis (memos patched between turns, mirrored sides, cached cuts, results pondered
+	 * on the first turn), the zobrist hash, the repaired ChainTree against FindPath, ScoreMove of
+	 * a commander which saw the previous turn. A case is two turns on a generated map, the second one
+	 * is a mutation of the first */
+	class Differential {
+		using Position = StateGenerator::Position;
+		using Clock = chrono::steady_clock;
+		enum { OUTLINE, FRONTIER, BRIDGES, CUTS, PROTECTION, THREATS, COMPONENTS, CHAINS, MOVES, WORKERS, KERNELS };
+	public:
+		explicit Differential(uint32_t seed) :
+			m_generator(seed),
+			m_rng(seed)
+		{
+		}
+		// false on a divergence: the minimized case is printed to @out as the input of its two turns
+		bool Run(int cases, ostream& out) {
+			for (int i = 0; i < cases; i++) {
+				m_generator.Generate(-1);
+				// the sides mirror each other: the views of one side are mirrored to the other
+				if (m_rng() % 4 == 0) m_generator.Symmetrize();
+				Position before{ m_generator.Current() };
+				for (int k = 1 + static_cast<int>(m_rng() % 3); k > 0; k--) m_generator.Mutate();
+				Position after{ m_generator.Current() };
+				// the ponderer is off, done or stopped after a few analyses
+				auto ponder{ m_rng() % 4 };
+				m_steps = ponder == 0 ? 0 : ponder == 1 ? numeric_limits<size_t>::max() : m_rng() % 16;
+				m_ponder = ponder != 0;
+				auto failed{ this->Check(before, after) };
+				m_reused += m_wasReused;
+				if (!failed) continue;
+				this->Minimize(before, after, failed);
+				cerr << "Case " << i << " diverges in " << failed << endl;
+				out << this->Text(before, true) << this->Text(after, false);
+				return false;
+			}
+			for (auto& kernel : m_kernels) {
+				auto reference{ chrono::duration_cast<chrono::microseconds>(kernel.reference).count() };
+				auto optimized{ chrono::duration_cast<chrono::microseconds>(kernel.optimized).count() };
+				cerr << kernel.name << ": reference " << reference << " us, optimized " << optimized << " us, x"
+					<< static_cast<double>(reference) / max<long long>(optimized, 1) << endl;
+			}
+			cerr << "pondered views were reused in " << m_reused << " of " << cases << " cases" << endl;
+			return true;
+		}
+
+	private:
+		struct Kernel {
+			const char*		name;
+			Clock::duration	reference{ 0 }, optimized{ 0 };
+		};
+		using Tiles = vector<pair<Vec2, int>>;
+
+		// name of the first kernel which diverges on @before then @after, nullptr if none does
+		const char* Check(const Position& before, const Position& after) {
+			Muted muted;
+			auto data{ make_unique<Data>() };
+			auto tables{ make_unique<StaticMap>() };
+			auto commander{ make_unique<Commander<MySide>>(data.get(), tables.get()) };
+			auto tree{ make_unique<ChainTree>() };
+			Feed(this->Text(before, true), [&data] {
+				data->Init();
+				data->Update();
+			});
+			tables->Build(*data);
+			if (auto failed{ this->Compare(*data, *tables, *commander, *tree, this->Text(before, true), nullptr) }) return failed;
+			// the first turn is predicted as the game does it, the results it got so far are used
+			if (m_ponder) m_ponderer->Start(*data, m_steps);
+			Feed(this->Text(after, false), [&data] { data->Update(); });
+			auto pondered{ m_ponder ? m_ponderer->Wait() : nullptr };
+			auto failed{ this->Compare(*data, *tables, *commander, *tree, this->Text(after, true), pondered) };
+			auto& analysis{ commander->Analysis() };
+			m_wasReused = pondered && (analysis.IsPonderedValid(Tile::mActive) || analysis.IsPonderedValid(Tile::eActive));
+			return failed;
+		}
+		// @fast went through the previous turns and gets @pondered, the reference is computed on @input read anew
+		const char* Compare(Data& data, const StaticMap& tables, Commander<MySide>& fast, ChainTree& tree, const string& input,
+			const PonderResult* pondered) {
+			auto cold{ make_unique<Data>() };
+			Feed(input, [&cold] {
+				cold->Init();
+				cold->Update();
+			});
+			auto slow{ make_unique<Commander<MySide>>(cold.get(), &tables) };
+			for (auto commander : { &fast, slow.get() }) commander->Clear();
+			fast.SetPondered(pondered);
+			for (auto commander : { &fast, slow.get() }) commander->Update();
+			if (data.Hash() != cold->Hash()) return "hash";
+			if (auto failed{ this->CompareSide<MySide>(fast, *slow, *cold) }) return failed;
+			if (auto failed{ this->CompareSide<EnemySide>(fast, *slow, *cold) }) return failed;
+
+			// chains to the enemy's HQ from my outline, as TryChainAttack asks for them
+			CCSearch search(&data.m_map, &data.m_uManager, &data.m_bManager), reference(&cold->m_map, &cold->m_uManager, &cold->m_bManager);
+			Vec2 eHQ{ data.m_bManager.HQ(1) };
+			ChainTree::Costs costs;
+			for (int y = 0; y < Map::HEIGHT; y++) {
+				for (int x = 0; x < Map::WIDTH; x++) {
+					Tile ty{ data.m_map.Get(Vec2{ x, y }) };
+					costs[y][x] = ty == Tile::blocked || ty == MySide::active ? ChainTree::INF : search.Cost<MySide>(Vec2{ x, y });
+				}
+			}
+			auto outline{ reference.GetOutline(MySide::active) };
+			auto capped = [](int cost) { return min(cost, ChainTree::INF); };
+			if (!this->Same(m_kernels[CHAINS], [&] {
+				vector<int> chains;
+				for (auto[tile, score] : outline) {
+					reference.FindPath<MySide>(tile, eHQ);
+					chains.push_back(capped(reference.GetCost(eHQ)));
+				}
+				return chains;
+			}, [&] {
+				if (tree.IsBuilt(eHQ)) tree.Update(costs);
+				else tree.Build(eHQ, costs);
+				vector<int> chains;
+				for (auto[tile, score] : outline) chains.push_back(capped(tree.Distance(tile)));
+				return chains;
+			})) return m_kernels[CHAINS].name;
+
+			// targets of my units as Move scores them
+			array<Vec2, 5> shift{ Vec2{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {0, 0} };
+			for (auto& unit : cold->m_uManager.m_units) {
+				if (!MySide::Owns(unit.m_owner)) continue;
+				for (auto& sh : shift) {
+					auto dest{ unit.m_pos + sh };
+					if (!IsValid(dest) || cold->m_map.Get(dest) == Tile::blocked) continue;
+					auto occupant{ cold->m_uManager.GetUnitAt(dest) };
+					auto building{ cold->m_bManager.GetBuildingAt(dest) };
+					if (dest != unit.m_pos && occupant.has_value() && MySide::Owns(occupant->m_owner)) continue;
+					if (building.has_value() && MySide::Owns(building->m_owner)) continue;
+					if (!this->Same(m_kernels[MOVES], [&] { return slow->ScoreMove(dest, unit); },
+						[&] { return fast.ScoreMove(dest, unit); })) return m_kernels[MOVES].name;
+				}
+			}
+
+			// bridges and their cuts of both sides, as the pool splits them: in order, whatever the workers
+			auto parallel = [&](size_t workers) {
+				auto analysis{ make_unique<TurnAnalysis>(cold.get(), &tables, workers) };
+				analysis->Reset(nullptr, true);
+				analysis->UpdateBridges();
+				vector<pair<vector<pair<Vec2, Vec2>>, vector<pair<int, Vec2>>>> sides;
+				for (Tile type : { MySide::active, EnemySide::active }) {
+					auto& bridges{ analysis->Bridges(type) };
+					auto cuts{ analysis->CutValues(bridges, type) };
+					sides.emplace_back(vector<pair<Vec2, Vec2>>(bridges.begin(), bridges.end()), vector<pair<int, Vec2>>(cuts.begin(), cuts.end()));
+				}
+				return sides;
+			};
+			if (!this->Same(m_kernels[WORKERS], [&] { return parallel(1); },
+				[&] { return parallel(m_workers); })) return m_kernels[WORKERS].name;
+			return nullptr;
+		}
+		template <class S>
+		const char* CompareSide(Commander<MySide>& fast, Commander<MySide>& slow, Data& cold) {
+			auto& analysis{ fast.Analysis() };
+			CCSearch search(&cold.m_map, &cold.m_uManager, &cold.m_bManager);
+			auto bridges{ make_unique<Bridges>(&cold.m_map) };
+			Vec2 HQ{ S::HQ(cold) };
+			auto sorted = [](const TileList& list) {
+				Tiles tiles(list.begin(), list.end());
+				sort(tiles.begin(), tiles.end());
+				return tiles;
+			};
+			if (!this->Same(m_kernels[OUTLINE], [&] { return sorted(search.GetOutline(S::active)); },
+				[&] { return sorted(analysis.Outline<S>()); })) return m_kernels[OUTLINE].name;
+			if (!this->Same(m_kernels[FRONTIER], [&] { return sorted(search.GetBoarderTiles(S::active)); },
+				[&] { return sorted(analysis.Frontier<S>()); })) return m_kernels[FRONTIER].name;
+			// a bridge is an edge: ends in any order
+			auto edges = [](const BridgeList& list) {
+				vector<pair<Vec2, Vec2>> edges;
+				for (auto[from, to] : list) edges.emplace_back(min(from, to), max(from, to));
+				sort(edges.begin(), edges.end());
+				return edges;
+			};
+			vector<pair<Vec2, Vec2>> expected;
+			if (!this->Same(m_kernels[BRIDGES], [&] { return expected = edges(bridges->GetBridges(S::active, HQ)); },
+				[&] { return edges(analysis.Bridges(S::active)); })) return m_kernels[BRIDGES].name;
+			for (auto[from, to] : expected) {
+				for (Vec2 bridge : { from, to }) {
+					if (!this->Same(m_kernels[CUTS], [&] {
+						search.Clear();
+						return search.GetScoreAfterBridge(HQ, bridge, S::active);
+					}, [&] { return analysis.CutValue(bridge, S::active); })) return m_kernels[CUTS].name;
+				}
+			}
+			auto& reference{ slow.Analysis() };
+			for (int y = 0; y < Map::HEIGHT; y++) {
+				for (int x = 0; x < Map::WIDTH; x++) {
+					Vec2 p{ x, y };
+					if (!this->Same(m_kernels[PROTECTION], [&] { return cold.m_bManager.IsProtected(p, cold.m_map); },
+						[&] { return analysis.IsProtected(p); })) return m_kernels[PROTECTION].name;
+					if (!this->Same(m_kernels[THREATS], [&] { return reference.FoeLevelsAround<S>(p); },
+						[&] { return analysis.FoeLevelsAround<S>(p); })) return m_kernels[THREATS].name;
+					auto size = [](const optional<CCSearch::Component>& c) {
+						return c ? make_tuple(c->tiles, c->towers, c->mines) : make_tuple(-1, -1, -1);
+					};
+					if (!this->Same(m_kernels[COMPONENTS], [&] { return size(reference.InactiveComponent<S>(p)); },
+						[&] { return size(analysis.InactiveComponent<S>(p)); })) return m_kernels[COMPONENTS].name;
+				}
+			}
+			return nullptr;
+		}
+		// both backends of @kernel timed on the same input
+		template <class Reference, class Optimized>
+		bool Same(Kernel& kernel, Reference reference, Optimized optimized) {
+			auto start{ Clock::now() };
+			auto expected{ reference() };
+			auto middle{ Clock::now() };
+			auto actual{ optimized() };
+			kernel.reference += middle - start;
+			kernel.optimized += Clock::now() - middle;
+			return expected == actual;
+		}
+		// edits are kept while the same kernel diverges: units, buildings and territory go, gold is spent
+		void Minimize(Position& before, Position& after, const char* failed) {
+			const int EDITS{ 3 * Map::AREA + 1 };
+			for (bool shrunk = true; shrunk; ) {
+				shrunk = false;
+				for (int edit = 0; edit < EDITS; edit++) {
+					auto first{ before }, second{ after };
+					bool changed{ this->Simplify(first, edit) };
+					changed |= this->Simplify(second, edit);
+					if (!changed) continue;
+					auto failure{ this->Check(first, second) };
+					if (!failure || string(failure) != failed) continue;
+					before = first, after = second;
+					shrunk = true;
+				}
+			}
+		}
+		// @edit of a cell: its unit goes, its building goes, it becomes neutral; or nobody has gold
+		bool Simplify(Position& position, int edit) {
+			auto& board{ position.board };
+			auto& buildings{ position.buildings };
+			if (edit == 3 * Map::AREA) {
+				bool changed{ false };
+				for (auto& player : position.players) {
+					changed |= player.m_gold != 0;
+					player.m_gold = 0;
+				}
+				return changed;
+			}
+			Vec2 p{ edit / 3 % Map::WIDTH, edit / 3 / Map::WIDTH };
+			auto& tile{ board.tiles[p.y][p.x] };
+			auto& unit{ board.units[p.y][p.x] };
+			auto& building{ buildings[p.y][p.x] };
+			bool isHQ{ building != StateGenerator::Rules::NONE && building % 3 == toInt(BType::HQ) };
+			switch (edit % 3) {
+			case 0:
+				if (!unit) return false;
+				unit = 0;
+				break;
+			case 1:
+				if (building == StateGenerator::Rules::NONE || isHQ) return false;
+				building = StateGenerator::Rules::NONE;
+				break;
+			default:
+				if (tile == Tile::neutral || tile == Tile::blocked || isHQ) return false;
+				tile = Tile::neutral;
+			}
+			m_generator.Restore(position);
+			m_generator.Repair();
+			position = m_generator.Current();
+			return true;
+		}
+		// input of a turn, with the mine spots in front for the first one
+		string Text(const Position& position, bool mines) {
+			ostringstream out;
+			m_generator.Restore(position);
+			if (mines) m_generator.Print(out);
+			else m_generator.PrintTurn(out);
+			return out.str();
+		}
+
+		StateGenerator m_generator;
+		mt19937 m_rng;
+		array<Kernel, KERNELS> m_kernels{ Kernel{ "outline" }, { "frontier" }, { "bridges" }, { "cuts" },
+			{ "protection" }, { "threats" }, { "components" }, { "chains" }, { "moves" }, { "workers" } };
+		// of the parallel analysis checked against one worker: --threads or 4
+		size_t m_workers{ Config::threads > 1 ? Config::threads : 4 };
+		// predicts the second turn of a case from the first one
+		unique_ptr<Ponderer> m_ponderer{ make_unique<Ponderer>() };
+		bool m_ponder{ false };
+		size_t m_steps{ 0 }; // analyses pondered before it's stopped
+		bool m_wasReused{ false };
+		int m_reused{ 0 };
+	};
+
+	/* hill climbing on the turn time: generated positions are mutated while they don't get faster,
+	 * a stale climb restarts on a new map. The slowest states found are written to @corpus
+	 * in the input format, so the file replays as a regression set */
+	void Fuzz(uint32_t seed, int iterations, const string& corpus) {
+		const int KEEP{ 16 }, STALE{ 64 }, REPEATS{ 3 };
+		StateGenerator generator(seed);
+		mt19937 rng{ seed };
+		// the fastest of some runs is the least noisy
+		auto measure = [&](const string& state) {
+			ostringstream answer;
+			auto best{ chrono::microseconds::max() };
+			for (int i = 0; i < REPEATS; i++) {
+				chrono::microseconds spent;
+				answer.str({});
+				RunTurn(state, answer, spent);
+				best = min(best, spent);
+			}
+			return best;
+		};
+		auto text = [&generator]() {
+			ostringstream out;
+			generator.Print(out);
+			return out.str();
+		};
+		vector<pair<chrono::microseconds, string>> worst;
+		auto record = [&worst, KEEP](chrono::microseconds spent, const string& state) {
+			if (any_of(worst.begin(), worst.end(), [&state](const auto& w) { return w.second == state; })) return;
+			worst.emplace_back(spent, state);
+			sort(worst.begin(), worst.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+			if (worst.size() > KEEP) worst.pop_back();
+		};
+
+		chrono::microseconds current{ 0 };
+		for (int i = 0, stale = STALE; i < iterations; i++) {
+			if (stale >= STALE) {
+				generator.Generate(-1);
+				auto state{ text() };
+				current = measure(state);
+				record(current, state);
+				stale = 0;
+				continue;
+			}
+			auto saved{ generator.Current() };
+			for (int k = 1 + static_cast<int>(rng() % 3); k > 0; k--) generator.Mutate();
+			auto state{ text() };
+			auto spent{ measure(state) };
+			if (spent >= current) {
+				if (spent > current) stale = 0;
+				current = spent;
+				record(spent, state);
+			}
+			else {
+				generator.Restore(saved);
+				stale++;
+			}
+		}
+
+		ofstream out{ corpus };
+		for (auto& [spent, state] : worst) {
+			out << state;
+			cerr << spent.count() << " us\n";
+		}
+	}
 };
 
-int main() {
-	Game().Loop();
+int main(int argc, char** argv) {
+	// switches of the bot and the tools come first: --threads <workers of every analysis>, --ponder
+	for (bool more = true; more; ) {
+		more = false;
+		if (argc >= 3 && string(argv[1]) == "--threads") {
+			Config::threads = max<size_t>(stoul(argv[2]), 1);
+			argc -= 2, argv += 2, more = true;
+		}
+		if (argc >= 2 && string(argv[1]) == "--ponder") {
+			Config::ponder = true;
+			argc -= 1, argv += 1, more = true;
+		}
+	}
+	// tools instead of the bot: --generate <seed> <count> [turns], --fuzz <seed> <iterations> <corpus>,
+	// --diff <seed> <cases>, --pack <text> <corpus> [turns per game], --unpack <corpus>,
+	// --batch <states> [threads] (games per thread, each analysis has --threads workers),
+	// --playouts <seed> <positions> [horizon] [count]
+	if (argc >= 3 && string(argv[1]) == "--batch") {
+		tools::Batch batch;
+		if (!batch.Load(argv[2])) return 1;
+		batch.Run(argc > 3 ? stoul(argv[3]) : 1, cout);
+		return 0;
+	}
+	if (argc >= 4 && string(argv[1]) == "--pack") {
+		return tools::Pack(argv[2], argv[3], argc > 4 ? stoi(argv[4]) : 1) ? 0 : 1;
+	}
+	if (argc >= 3 && string(argv[1]) == "--unpack") {
+		return tools::Unpack(argv[2], cout) ? 0 : 1;
+	}
+	if (argc >= 4 && string(argv[1]) == "--diff") {
+		return make_unique<tools::Differential>(static_cast<uint32_t>(stoul(argv[2])))->Run(stoi(argv[3]), cout) ? 0 : 1;
+	}
+	if (argc >= 4 && string(argv[1]) == "--playouts") {
+		int horizon{ argc > 4 ? stoi(argv[4]) : Config::horizon }, count{ argc > 5 ? stoi(argv[5]) : max(Config::rollouts, 32) };
+		return tools::Playouts(static_cast<uint32_t>(stoul(argv[2])), stoi(argv[3]), horizon, count, cout) ? 0 : 1;
+	}
+	if (argc >= 5 && string(argv[1]) == "--fuzz") {
+		tools::Fuzz(static_cast<uint32_t>(stoul(argv[2])), stoi(argv[3]), argv[4]);
+		return 0;
+	}
+	if (argc >= 4 && string(argv[1]) == "--generate") {
+		StateGenerator generator(static_cast<uint32_t>(stoul(argv[2])));
+		for (int i = 0, count = stoi(argv[3]); i < count; i++) {
+			generator.Generate(argc > 4 ? stoi(argv[4]) : -1);
+			generator.Print(cout);
+		}
+		return 0;
+	}
+	// the tables grow with the map, they don't fit the stack of a larger one
+	make_unique<Game>()->Loop();
 }
\ No newline at end of file